@@ -1,21 +1,63 @@
 #ifndef SHION_CACHE_H_
 #define SHION_CACHE_H_
 
+#include <shion/common/defines.hpp>
+
+#if !SHION_BUILDING_MODULES
 #include <atomic>
 #include <type_traits>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <mutex>
-#include <list>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
 #include <cassert>
 #include <optional>
+#include <ranges>
 #include <utility>
+#include <vector>
 
-#include "shion_essentials.hpp"
+#include <shion/common.hpp>
+#include <shion/coro/task.hpp>
+#include <shion/io/serializer.hpp>
+#include <shion/io/utils.hpp>
+#endif
 
-namespace shion {
+#if __has_include(<sys/mman.h>)
+#	if !SHION_BUILDING_MODULES
+#		include <fcntl.h>
+#		include <sys/mman.h>
+#		include <sys/stat.h>
+#		include <unistd.h>
+#	endif
+#	define SHION_CACHE_MAPPED_SNAPSHOTS 1
+#else
+#	define SHION_CACHE_MAPPED_SNAPSHOTS 0
+#endif
 
-template <typename Value>
+namespace SHION_NAMESPACE {
+
+SHION_EXPORT template <typename Value>
 class cached_resource;
 
+SHION_EXPORT template <typename Key, typename Value, typename Hasher, typename Equal, typename Eviction>
+class cache;
+
 namespace detail {
 
 template <typename Value>
@@ -47,6 +89,21 @@ public:
 		return ref_count.load(std::memory_order_relaxed) > 0;
 	}
 
+	[[nodiscard]] intptr_t use_count() const noexcept {
+		return ref_count.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * @brief Whether handles count their references in per-thread tables rather than in `ref_count`, see `cache_reference_table`.
+	 */
+	[[nodiscard]] bool per_thread_references() const noexcept {
+		return per_thread;
+	}
+
+	void set_per_thread_references(bool enabled) noexcept {
+		per_thread = enabled;
+	}
+
 	template <typename... Args>
 	[[nodiscard]] cached_resource<Value> emplace(Args&&... args)
 	noexcept(std::is_nothrow_constructible_v<std::remove_cvref_t<Value>, Args...>);
@@ -62,6 +119,7 @@ private:
 	}
 
 	std::atomic<intptr_t> ref_count{0};
+	bool                  per_thread{false};
 	union {
 		Value v;
 	};
@@ -70,326 +128,2593 @@ private:
 template <typename T>
 using shared_cached_resource = stored_cache_resource<std::conditional_t<std::is_reference_v<T>, std::add_pointer_t<T>, std::remove_const_t<T>>>;
 
+inline void cache_prefetch([[maybe_unused]] void const* address) noexcept {
+#if defined(__GNUC__)
+	__builtin_prefetch(address);
+#endif
 }
 
-template <typename Value>
-class cached_resource {
-	template <typename, typename, typename, typename>
-	friend class cache;
+/**
+ * @brief Open-addressing hash index from hashes to nodes, in the style of a Swiss table.
+ *
+ * Each slot has a control byte holding 7 bits of the hash, or a marker for empty and deleted slots.
+ * Slots are probed 8 at a time: the control bytes of a group are stored as one 64-bit word and matched with bit tricks,
+ * so most lookups touch a single group and compare only the nodes whose hash bits match.
+ *
+ * Words and slots are accessed atomically, so that `find` can run concurrently with a single writer.
+ * For that, see `set_concurrent_readers`: tables replaced by a rehash are then kept until `reclaim` says no reader can still use them.
+ */
+template <typename Node>
+class cache_index {
+public:
+	/**
+	 * @brief Returns the first node with `hash` for which `pred` returns true, or nullptr.
+	 */
+	template <typename Pred>
+	Node* find(size_t hash, Pred&& pred) const noexcept(std::is_nothrow_invocable_v<Pred&, Node&>) {
+		table const* t = _table.load(std::memory_order_acquire);
+
+		if (t == nullptr) {
+			return nullptr;
+		}
+		for (size_t group = _first_group(*t, hash), i = 0;; group = (group + ++i) & t->group_mask) {
+			uint64_t control = _load(t->control[group]);
 
-	using resource = detail::shared_cached_resource<Value>;
+			for (auto matches = _match(control, _h2(hash)); matches != 0; matches &= matches - 1) {
+				// Null if a concurrent writer erased the node after we loaded the group
+				Node* node = _load(t->slots[group * group_width + (std::countr_zero(matches) >> 3)]);
 
-	friend resource;
+				if (node != nullptr && pred(*node)) {
+					return node;
+				}
+			}
+			if (_match_empty(control) != 0) {
+				return nullptr;
+			}
+		}
+	}
 
-	using value_t = typename resource::value_t;
+	/**
+	 * @brief Makes room for `count` nodes, so that inserting up to that many cannot fail.
+	 */
+	void reserve(size_t count) {
+		size_t slots = capacity();
 
-	cached_resource(resource& res) noexcept :
-		ptr{&res} {
-		ptr->increment();
+		if ((count + _deleted) * 8 <= slots * 7) {
+			return;
+		}
+		// Only grow if the table is actually full of live nodes, otherwise rehashing just clears the tombstones
+		if (count * 8 <= slots * 7 && count * 2 <= slots) {
+			_rehash(slots);
+		} else {
+			_rehash(std::max(std::bit_ceil(count * 8 / 7 + 1), group_width * 2));
+		}
 	}
 
-public:
-	friend class cached_resource<std::add_const_t<Value>>;
+	/**
+	 * @brief Adds `node` under `hash`. There must be room for it, see `reserve`.
+	 */
+	void insert(size_t hash, Node* node) noexcept {
+		assert((_size + _deleted + 1) * 8 <= capacity() * 7);
 
-	cached_resource() noexcept = default;
+		_insert(*_current, hash, node);
+		++_size;
+	}
 
-	cached_resource(const cached_resource &other) noexcept :
-		ptr{other.ptr} {
-		if (ptr) {
-			ptr->increment();
+	/**
+	 * @brief Removes `node`, which must be in the index under `hash`.
+	 */
+	void erase(size_t hash, Node const* node) noexcept {
+		table& t = *_current;
+
+		for (size_t group = _first_group(t, hash), i = 0;; group = (group + ++i) & t.group_mask) {
+			uint64_t control = _load(t.control[group]);
+
+			for (auto matches = _match(control, _h2(hash)); matches != 0; matches &= matches - 1) {
+				size_t byte = std::countr_zero(matches) >> 3;
+
+				if (_load(t.slots[group * group_width + byte]) == node) {
+					// A slot can only go back to empty if no probe sequence ever continued past its group
+					uint8_t marker = _match_empty(control) != 0 ? empty : deleted;
+
+					_store(t.control[group], _set_byte(control, byte, marker));
+					_store(t.slots[group * group_width + byte], static_cast<Node*>(nullptr));
+					--_size;
+					_deleted += (marker == deleted);
+					return;
+				}
+			}
+			assert(_match_empty(control) == 0);
 		}
 	}
 
-	cached_resource(const cached_resource<std::remove_const_t<Value>> &other) noexcept
-		requires(std::is_const_v<Value>) :
-		ptr{other.ptr} {
-		if (ptr) {
-			ptr->increment();
-		}
+	/**
+	 * @brief Whether `find` may run concurrently with the other members. If so, replaced tables are kept until `reclaim`.
+	 */
+	void set_concurrent_readers(bool concurrent) noexcept {
+		_concurrent_readers = concurrent;
 	}
 
-	cached_resource(cached_resource&& rhs) noexcept :
-		ptr{std::exchange(rhs.ptr, nullptr)}
-	{}
+	/**
+	 * @brief Frees the tables replaced by rehashes. No `find` which started before them being replaced may still be running.
+	 */
+	void reclaim() noexcept {
+		_retired.clear();
+	}
 
-	~cached_resource() {
-		if (ptr) {
-			ptr->decrement();
-		}
+	bool has_retired() const noexcept {
+		return !_retired.empty();
 	}
 
-	cached_resource &operator=(const cached_resource &other) noexcept {
-		ptr = other.ptr;
-		if (ptr) {
-			ptr->increment();
+	/**
+	 * @brief Starts loading the first group `find` probes for `hash` into the cache, to overlap the latency of several lookups.
+	 */
+	void prefetch(size_t hash) const noexcept {
+		if (table const* t = _table.load(std::memory_order_acquire); t != nullptr) {
+			size_t group = _first_group(*t, hash);
+
+			cache_prefetch(&t->control[group]);
+			cache_prefetch(&t->slots[group * group_width]);
 		}
-		return *this;
 	}
 
-	cached_resource &operator=(cached_resource &&other) noexcept {
-		ptr = std::exchange(other.ptr, nullptr);
-		return *this;
+	size_t size() const noexcept {
+		return _size;
 	}
 
-	constexpr explicit operator bool() const noexcept {
-		return ptr;
+	size_t capacity() const noexcept {
+		return _current ? (_current->group_mask + 1) * group_width : 0;
 	}
 
-	[[nodiscard]] auto operator*() const noexcept -> std::add_lvalue_reference_t<std::add_const_t<Value>> {
-		assert(ptr);
-
-		if constexpr (std::is_reference_v<Value>) {
-			return *ptr->get();
-		} else {
-			return ptr->get();
+private:
+	static constexpr size_t   group_width = 8;
+	static constexpr uint8_t  empty = 0b1000'0000;
+	static constexpr uint8_t  deleted = 0b1111'1110;
+	static constexpr uint64_t lsbs = 0x0101'0101'0101'0101ull;
+	static constexpr uint64_t msbs = 0x8080'8080'8080'8080ull;
+
+	// Byte `i` of a group's control word is the control byte of its slot `i`
+	struct table {
+		explicit table(size_t capacity) :
+			group_mask{capacity / group_width - 1},
+			control{std::make_unique<uint64_t[]>(capacity / group_width)},
+			slots{std::make_unique<Node*[]>(capacity)} {
+			std::fill_n(control.get(), capacity / group_width, lsbs * empty);
 		}
+
+		size_t                      group_mask;
+		std::unique_ptr<uint64_t[]> control;
+		std::unique_ptr<Node*[]>    slots;
+	};
+
+	// Sequentially consistent, so that a reader which announced itself to a `cache_epoch` sees every removal that preceded `synchronize`
+	template <typename T>
+	static T _load(T const& value) noexcept {
+		return std::atomic_ref<T>{const_cast<T&>(value)}.load(std::memory_order_seq_cst);
 	}
 
-	[[nodiscard]] auto operator*() noexcept -> std::add_lvalue_reference_t<Value>{
-		assert(ptr);
+	template <typename T>
+	static void _store(T& value, T desired) noexcept {
+		std::atomic_ref<T>{value}.store(desired, std::memory_order_release);
+	}
 
-		if constexpr (std::is_reference_v<Value>) {
-			return *ptr->get();
-		} else {
-			return ptr->get();
-		}
+	static uint64_t _set_byte(uint64_t control, size_t byte, uint8_t value) noexcept {
+		return (control & ~(uint64_t{0xFF} << (byte * 8))) | (uint64_t{value} << (byte * 8));
 	}
 
-	std::add_pointer_t<Value> operator->() noexcept {
-		assert(ptr);
+	// Hashers like std::hash<int> are often the identity, scramble the bits so that consecutive keys don't cluster
+	static size_t _mix(size_t hash) noexcept {
+		uint64_t mixed = (static_cast<uint64_t>(hash) ^ (static_cast<uint64_t>(hash) >> 31)) * 0xBF58'476D'1CE4'E5B9ull;
 
-		return &ptr->get();
+		return static_cast<size_t>(mixed ^ (mixed >> 32));
 	}
 
-	std::add_pointer_t<std::add_const_t<Value>> *operator->() const noexcept {
-		assert(ptr);
+	static uint8_t _h2(size_t hash) noexcept {
+		return static_cast<uint8_t>(_mix(hash) & 0x7F);
+	}
 
-		return &ptr->operator*();
+	static size_t _first_group(table const& t, size_t hash) noexcept {
+		return (_mix(hash) >> 7) & t.group_mask;
 	}
 
-	std::add_const_t<value_t> &get() const {
-		cached_resource const& self = *this;
-		if (!self) {
-			throw std::bad_optional_access{};
-		}
-		return self.operator*();
+	// Has the high bit set in every byte equal to `h2`, and possibly in a few bytes just above a match
+	static uint64_t _match(uint64_t control, uint8_t h2) noexcept {
+		uint64_t x = control ^ (lsbs * h2);
+
+		return (x - lsbs) & ~x & msbs;
 	}
 
-	value_t& get() {
-		cached_resource& self = *this;
-		if (!self) {
-			throw std::bad_optional_access{};
+	// Has the high bit set in every empty byte: only empty bytes have the high bit set and bit 1 clear
+	static uint64_t _match_empty(uint64_t control) noexcept {
+		return control & ~(control << 6) & msbs;
+	}
+
+	// Has the high bit set in every empty or deleted byte
+	static uint64_t _match_free(uint64_t control) noexcept {
+		return control & msbs;
+	}
+
+	void _insert(table& t, size_t hash, Node* node) noexcept {
+		for (size_t group = _first_group(t, hash), i = 0;; group = (group + ++i) & t.group_mask) {
+			uint64_t control = _load(t.control[group]);
+
+			if (auto free = _match_free(control); free != 0) {
+				size_t byte = std::countr_zero(free) >> 3;
+
+				_deleted -= (((control >> (byte * 8)) & 0xFF) == deleted);
+				// Publish the node before the control byte, so that readers matching the byte find it
+				_store(t.slots[group * group_width + byte], node);
+				_store(t.control[group], _set_byte(control, byte, _h2(hash)));
+				return;
+			}
 		}
-		return self.operator*();
 	}
 
-	void release() noexcept {
-		if (ptr) {
-			ptr->decrement();
+	void _rehash(size_t capacity) {
+		auto next = std::make_unique<table>(capacity);
+
+		_deleted = 0;
+		if (_current) {
+			for (size_t i = 0; i <= _current->group_mask; ++i) {
+				for (auto live = ~_current->control[i] & msbs; live != 0; live &= live - 1) {
+					Node* node = _current->slots[i * group_width + (std::countr_zero(live) >> 3)];
+
+					_insert(*next, node->hash, node);
+				}
+			}
 		}
-		ptr = nullptr;
+		_table.store(next.get(), std::memory_order_release);
+		if (_current && _concurrent_readers) {
+			_retired.push_back(std::move(_current));
+		}
+		_current = std::move(next);
 	}
 
-private:
-	resource* ptr = nullptr;
+	std::unique_ptr<table>              _current;
+	std::atomic<table*>                 _table{nullptr};
+	std::vector<std::unique_ptr<table>> _retired;
+	size_t                              _size{0};
+	size_t                              _deleted{0};
+	bool                                _concurrent_readers{false};
 };
 
-template <typename Value>
-requires (!std::is_reference_v<Value> && !std::is_const_v<Value>)
-template <typename... Args>
-[[nodiscard]] cached_resource<Value> detail::stored_cache_resource<Value>::emplace(Args&&... args)
-noexcept(std::is_nothrow_constructible_v<std::remove_cvref_t<Value>, Args...>) {
-	assert(ref_count == 0);
-	std::construct_at(
-		&v,
-		std::forward<Args>(args)...
-	);
-	return {*this};
-}
+template <typename Node>
+struct cache_list_hook {
+	Node* prev{nullptr};
+	Node* next{nullptr};
+};
 
-template <typename Key, typename Value, typename Hasher, typename Equal>
-class cache {
-private:
+/**
+ * @brief Intrusive doubly-linked list of nodes, linked through the `cache_list_hook` returned by `Hook`.
+ */
+template <typename Node, auto Hook>
+class cache_list {
 public:
-	constexpr cache() noexcept = default;
-	cache(const cache&) = delete;
-	cache(cache&&) = delete;
-	cache &operator=(const cache&) = delete;
-	cache &operator=(cache&&) = delete;
+	void push_front(Node& node) noexcept {
+		_hook(node) = {nullptr, _head};
+		if (_head != nullptr) {
+			_hook(*_head).prev = &node;
+		} else {
+			_tail = &node;
+		}
+		_head = &node;
+		++_size;
+	}
 
-	using element_t = std::pair<Key, Value>;
-	using value_t = cached_resource<Value>;
+	/**
+	 * @brief Inserts `node` right after `pos`, on the side of the back.
+	 */
+	void insert_after(Node& pos, Node& node) noexcept {
+		Node* next = _hook(pos).next;
 
-	template <typename T>
-	static inline constexpr auto nothrow_hash = noexcept(Hasher{}(std::declval<T>()));
+		_hook(node) = {&pos, next};
+		(next != nullptr ? _hook(*next).prev : _tail) = &node;
+		_hook(pos).next = &node;
+		++_size;
+	}
 
-	template <typename T>
-	static inline constexpr auto nothrow_equal = noexcept(Equal{}(std::declval<Key const&>(), std::declval<T>()));
+	void erase(Node& node) noexcept {
+		auto& hook = _hook(node);
 
-	template <typename T>
-	static inline constexpr auto nothrow_lookup = noexcept(nothrow_hash<T> && nothrow_equal<T>);
+		(hook.prev != nullptr ? _hook(*hook.prev).next : _head) = hook.next;
+		(hook.next != nullptr ? _hook(*hook.next).prev : _tail) = hook.prev;
+		hook = {};
+		--_size;
+	}
 
-	template <typename T, typename... Args>
-	static inline constexpr auto nothrow_emplace = std::is_nothrow_constructible_v<Key, T> && std::is_nothrow_constructible_v<Value, Args...>;
+	void move_to_front(Node& node) noexcept {
+		if (_head != &node) {
+			erase(node);
+			push_front(node);
+		}
+	}
 
-private:
-	using resource = typename cached_resource<Value>::resource;
+	Node* back() const noexcept {
+		return _tail;
+	}
 
-	struct node {
-		size_t hash{0};
-		std::pair<Key, resource> elem;
-		cached_resource<Value> my_ref;
-	};
+	Node* prev(Node& node) const noexcept {
+		return _hook(node).prev;
+	}
 
-	struct bucket {
-		static constexpr size_t num_elements = std::max(32ull, (32ull * 1024 / (sizeof(node))));
-		using storage = std::array<node, num_elements>;
-		using storage_iterator = std::ranges::iterator_t<storage>;
+	size_t size() const noexcept {
+		return _size;
+	}
 
-		constexpr auto begin() {
-			return data.begin();
+	/**
+	 * @brief Returns the first node from the back for which `pred` returns true, looking at no more than `max_scan` nodes.
+	 */
+	template <typename Pred>
+	Node* find_from_back(Pred& pred, size_t max_scan) const {
+		Node* node = _tail;
+
+		for (size_t i = 0; node != nullptr && i < max_scan; ++i, node = _hook(*node).prev) {
+			if (pred(*node)) {
+				return node;
+			}
 		}
+		return nullptr;
+	}
 
-		constexpr auto begin() const {
-			return data.begin();
+private:
+	static cache_list_hook<Node>& _hook(Node& node) noexcept {
+		return std::invoke(Hook, node);
+	}
+
+	Node*  _head{nullptr};
+	Node*  _tail{nullptr};
+	size_t _size{0};
+};
+
+/**
+ * @brief Count-min sketch of access frequencies, with 4 rows of counters saturating at 15.
+ *
+ * Counters are relaxed atomics so readers can record accesses concurrently; lost increments only make the estimate fuzzier.
+ * Every counter is halved once enough accesses were recorded, so that old popularity fades.
+ */
+class cache_frequency_sketch {
+public:
+	/**
+	 * @brief Resizes the sketch for about `expected_entries` distinct entries, forgetting all frequencies if it grows.
+	 */
+	void reserve(size_t expected_entries) {
+		size_t width = std::bit_ceil(std::max(expected_entries, size_t{16}));
+
+		if (width > _width) {
+			_counters = std::make_unique<std::atomic<uint8_t>[]>(width * rows);
+			_width = width;
+			_additions.store(0, std::memory_order_relaxed);
 		}
+	}
 
-		constexpr auto end() {
-			return data.end();
+	void increment(size_t hash) noexcept {
+		if (_width == 0) {
+			return;
 		}
+		for (size_t row = 0; row < rows; ++row) {
+			auto& counter = _counters[_index(hash, row)];
 
-		constexpr auto end() const {
-			return data.end();
+			if (auto count = counter.load(std::memory_order_relaxed); count < 15) {
+				counter.store(count + 1, std::memory_order_relaxed);
+			}
 		}
+		_additions.fetch_add(1, std::memory_order_relaxed);
+	}
 
-		std::array<node, num_elements> data{};
-	};
+	uint8_t frequency(size_t hash) const noexcept {
+		uint8_t min = 15;
 
-public:
-	template <typename T>
-	cached_resource<Value> find(const T& key) noexcept(nothrow_lookup<T>) {
-		size_t hashed = hash(key);
-		std::shared_lock lock{mutex};
+		for (size_t row = 0; row < rows && _width != 0; ++row) {
+			min = std::min(min, _counters[_index(hash, row)].load(std::memory_order_relaxed));
+		}
+		return min;
+	}
 
-		return _find_hash(key, hashed);
+	/**
+	 * @brief Halves every counter if enough accesses were recorded since the last time. Must not run concurrently with `increment`.
+	 */
+	void age() noexcept {
+		if (_additions.load(std::memory_order_relaxed) < _width * 10) {
+			return;
+		}
+		for (size_t i = 0; i < _width * rows; ++i) {
+			_counters[i].store(_counters[i].load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+		}
+		_additions.store(0, std::memory_order_relaxed);
 	}
 
-	template <typename T>
-	cached_resource<std::add_const_t<Value>> find(const T& key) const noexcept(nothrow_lookup<T>) {
-		size_t hashed = hash(key);
-		std::shared_lock lock{mutex};
+private:
+	static constexpr size_t rows = 4;
 
-		return _find_hash(key, hashed);
+	size_t _index(size_t hash, size_t row) const noexcept {
+		constexpr uint64_t seeds[rows] = {0xC3A5'C85C'97CB'3127ull, 0xB492'B66F'BE98'F273ull, 0x9AE1'6A3B'2F90'404Full, 0xCBF2'9CE4'8422'2325ull};
+		uint64_t mixed = (static_cast<uint64_t>(hash) + seeds[row]) * seeds[(row + 1) % rows];
+
+		return row * _width + static_cast<size_t>((mixed ^ (mixed >> 32)) & (_width - 1));
 	}
 
-	template <typename T>
-	cached_resource<Value> find_hash(const T& key, size_t hash) noexcept(nothrow_equal<T>) {
-		std::shared_lock lock{mutex};
+	std::unique_ptr<std::atomic<uint8_t>[]> _counters;
+	size_t                                  _width{0};
+	std::atomic<size_t>                     _additions{0};
+};
 
-		return _find_hash(key, hash);
-	}
+/**
+ * @brief Number of stripes to spread per-thread data over: one per hardware thread, up to 64.
+ */
+inline size_t cache_num_stripes() noexcept {
+	return std::min(std::bit_ceil(std::max(size_t{std::thread::hardware_concurrency()}, size_t{1})), size_t{64});
+}
 
-	template <typename T>
-	cached_resource<std::add_const_t<Value>> find_hash(const T& key, size_t hash) const noexcept(nothrow_equal<T>) {
-		std::shared_lock lock{mutex};
+/**
+ * @brief Returns the calling thread's index, for picking its stripe.
+ *
+ * Threads are dealt indices in turn on their first call, which spreads them evenly over stripes.
+ */
+inline size_t cache_thread_index() noexcept {
+	static std::atomic<size_t> next_thread{0};
+	thread_local size_t const  thread_index = next_thread.fetch_add(1, std::memory_order_relaxed);
 
-		return _find_hash(key, hash);
-	}
+	return thread_index;
+}
 
-	template <typename T, typename... Args>
-	std::pair<cached_resource<Value>, bool> try_emplace(T&& key, Args&&... args) noexcept(nothrow_lookup<T> && nothrow_emplace<Args...>) {
-		size_t hashed = hash(key);
-		std::lock_guard lock{mutex};
+/**
+ * @brief Epoch-based reclamation: lets readers walk a structure without locks, while writers wait until no reader can still see what they removed.
+ *
+ * Readers announce themselves in one of two counters, picked by the parity of the epoch, in the stripe of their thread.
+ * `synchronize` flips the epoch and waits for the readers of the previous parity to leave, twice, so that every reader
+ * which entered before the call is gone when it returns. Readers never wait, and only write to their own stripe.
+ */
+class cache_epoch {
+	struct alignas(64) stripe {
+		std::array<std::atomic<size_t>, 2> readers{};
+	};
 
-		if (auto res = _find_hash(key, hashed); res) {
-			return {res, false};
+public:
+	/**
+	 * @brief Marks the calling thread as reading until destroyed.
+	 */
+	class guard {
+	public:
+		explicit guard(cache_epoch& epoch) noexcept :
+			_readers{&epoch._stripes[cache_thread_index() & (epoch._num_stripes - 1)].readers[epoch._epoch.load(std::memory_order_relaxed) & 1]} {
+			// Sequentially consistent, so that this is ordered with the loads of `synchronize`
+			_readers->fetch_add(1, std::memory_order_seq_cst);
 		}
 
-		return {_emplace(std::forward<T>(key), hashed, std::forward<Args>(args)...), true};
-	}
-
-	template <typename T>
-	requires (std::is_constructible_v<Key, T> && std::is_default_constructible_v<Value>)
-	cached_resource<Value> operator[](T&& key) noexcept (nothrow_lookup<T> && nothrow_emplace<T>) {
-		size_t hashed = hash(key);
-		std::lock_guard lock{mutex};
+		guard(guard const&) = delete;
+		guard& operator=(guard const&) = delete;
 
-		if (auto res = _find_hash(key, hashed); res) {
-			return res;
+		~guard() {
+			_readers->fetch_sub(1, std::memory_order_release);
 		}
 
-		return _emplace(std::forward<T>(key), hashed);
+	private:
+		std::atomic<size_t>* _readers;
+	};
+
+	cache_epoch() :
+		_num_stripes{cache_num_stripes()},
+		_stripes{std::make_unique<stripe[]>(_num_stripes)} {
 	}
 
-	template <typename T>
-	size_t hash(const T& key) const noexcept(nothrow_hash<const T&>) {
-		return Hasher{}(key);
+	/**
+	 * @brief Waits until every reader which entered before this call has left.
+	 *
+	 * Whatever was made unreachable before the call can then be freed, as no reader can still hold it.
+	 */
+	void synchronize() noexcept {
+		std::lock_guard lock{_mutex};
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		// A reader may have read the parity just before a flip and announce itself after the first wait, hence the second one
+		for (int i = 0; i < 2; ++i) {
+			size_t parity = _epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+
+			while (_readers(parity) != 0) {
+				std::this_thread::yield();
+			}
+		}
 	}
 
 private:
-	template <typename T>
-	cached_resource<Value> _find_hash(const T& key, size_t hash) noexcept(nothrow_equal<T>) {
-#ifdef _MSC_VER
-		if (_buckets.empty())
-			return {};
-#endif
-		for (bucket &b : _buckets) {
-			if (auto it = std::ranges::find(b, hash, &node::hash); it != b.end()) {
-				if (auto ref = it->my_ref; ref) { // use the reference here because that means the resource can't be destroyed in-between
-					if (it->elem.first == key) {
-						return ref;
-					}
-				}
-			}
+	size_t _readers(size_t parity) const noexcept {
+		size_t sum = 0;
+
+		for (stripe const& s : std::span{_stripes.get(), _num_stripes}) {
+			sum += s.readers[parity].load(std::memory_order_seq_cst);
 		}
-		return {};
+		return sum;
 	}
 
-	template <typename T>
-	cached_resource<std::add_const_t<Value>> _find_hash(const T& key, size_t hash) const noexcept(nothrow_equal<T>) {
-#ifdef _MSC_VER
-		if (_buckets.empty())
-			return {};
-#endif
-		for (const bucket &b : _buckets) {
-			if (auto it = std::ranges::find(b, hash, &node::hash); it != b.end()) {
-				if (it->my_ref) { // use the reference here because that means the resource can't be destroyed in-between
-					const auto& [elem_key, _] = *(it->my_ref);
-					if (elem_key == key) {
-						return it->my_ref;
-					}
-				}
-			}
+	std::atomic<size_t>       _epoch{0};
+	size_t                    _num_stripes;
+	std::unique_ptr<stripe[]> _stripes;
+	std::mutex                _mutex;
+};
+
+/**
+ * @brief Statistics counters, striped over cache lines so that threads counting at the same time don't contend.
+ *
+ * Each thread always counts into the same stripe, and reading a total sums all of them.
+ */
+class cache_counters {
+public:
+	enum counter : size_t {
+		hits,
+		misses,
+		inserts,
+		evictions,
+		expirations,
+		load_failures,
+		lock_wait_ns,
+		num_counters
+	};
+
+	static constexpr size_t num_latency_buckets = 32;
+
+	cache_counters() :
+		_num_stripes{cache_num_stripes()},
+		_stripes{std::make_unique<stripe[]>(_num_stripes)} {
+	}
+
+	void add(counter c, size_t amount = 1) noexcept {
+		_stripe().counters[c].fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Counts a load in bucket `log2(microseconds)` of the latency histogram.
+	 */
+	void add_load(std::chrono::steady_clock::duration latency) noexcept {
+		auto   us = static_cast<uint64_t>(std::max(std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), decltype(latency.count()){1}));
+		size_t bucket = std::min(static_cast<size_t>(std::bit_width(us) - 1), num_latency_buckets - 1);
+
+		_stripe().load_latency[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	size_t total(counter c) const noexcept {
+		size_t sum = 0;
+
+		for (stripe const& s : std::span{_stripes.get(), _num_stripes}) {
+			sum += s.counters[c].load(std::memory_order_relaxed);
 		}
-		return {};
+		return sum;
 	}
 
-	template <typename T, typename... Args>
-	cached_resource<Value> _emplace(T&& key, size_t hash, Args&&... args) noexcept(nothrow_emplace<T, Args...>) {
-		constexpr auto is_empty = [](const node &r) noexcept {
-			return !r.elem.second;
-		};
+	std::array<size_t, num_latency_buckets> load_latency() const noexcept {
+		std::array<size_t, num_latency_buckets> sum{};
 
-		for (bucket &b : _buckets) {
-			if (auto it = std::ranges::find_if(b, is_empty); it != b.end()) {
-				it->hash = hash;
-				it->elem.first = std::forward<T>(key);
-				it->my_ref = it->elem.second.emplace(std::forward<Args>(args)...);
-				return it->my_ref;
+		for (stripe const& s : std::span{_stripes.get(), _num_stripes}) {
+			for (size_t i = 0; i < num_latency_buckets; ++i) {
+				sum[i] += s.load_latency[i].load(std::memory_order_relaxed);
 			}
 		}
+		return sum;
+	}
+
+private:
+	struct alignas(64) stripe {
+		std::array<std::atomic<size_t>, num_counters>        counters{};
+		std::array<std::atomic<size_t>, num_latency_buckets> load_latency{};
+	};
+
+	stripe& _stripe() noexcept {
+		return _stripes[cache_thread_index() & (_num_stripes - 1)];
+	}
+
+	size_t                    _num_stripes;
+	std::unique_ptr<stripe[]> _stripes;
+};
+
+/**
+ * @brief Per-thread reference counts, so that threads copying handles to the same value don't contend on its count.
+ *
+ * A thread counts its references to a value in an entry of its own table, which holds a single reference to the value
+ * for all of them. When the last of them goes away, the entry keeps that reference idle, so that taking one again only
+ * touches the thread's own cache line. Idle references are given back when the entry is needed for another value,
+ * or when the owner of the value calls `revoke` to tell whether anyone still uses it.
+ *
+ * Tables are direct-mapped: a value whose entry is busy with another one is counted in its shared count instead.
+ * They are never freed, as handles may outlive their thread, but passed on to new threads when their thread exits.
+ * As they are never freed either, they are linked in a list which `revoke` walks without locking, so that evictions
+ * don't serialize on a process-wide mutex.
+ */
+class cache_reference_table {
+public:
+	using release_fn = void (*)(void const*) noexcept;
+
+	struct entry {
+		// `empty`, `idle`, `revoking`, or the number of handles counted here
+		std::atomic<intptr_t>    state{empty};
+		std::atomic<void const*> resource{nullptr};
+		std::atomic<release_fn>  release{nullptr};
+	};
+
+	static constexpr intptr_t empty = 0;     // Holds no reference
+	static constexpr intptr_t idle = -1;     // Holds a reference no handle uses
+	static constexpr intptr_t revoking = -2; // Its reference is being given back
+
+	/**
+	 * @brief Returns the calling thread's table.
+	 */
+	static cache_reference_table& local() noexcept {
+		struct lease {
+			lease() : table{_lease()} {}
+			lease(lease const&) = delete;
+			lease& operator=(lease const&) = delete;
+			~lease() { _return(table); }
+
+			cache_reference_table* table;
+		};
+		thread_local lease current;
+
+		return *current.table;
+	}
+
+	/**
+	 * @brief Counts a new reference to `resource` in this table, which must be the calling thread's.
+	 *
+	 * Returns the entry to give to `release` later, or nullptr if the reference was taken directly in the shared count.
+	 * `increment` takes a shared reference, which happens only when the entry doesn't hold one already.
+	 */
+	template <typename Increment>
+	entry* acquire(void const* resource, release_fn release, Increment&& increment) noexcept {
+		entry&   e = _entries[_slot(resource)];
+		intptr_t state = e.state.load(std::memory_order_relaxed);
+
+		// Only this thread writes `resource`, and only other threads write `state`, from `idle` to `revoking` to `empty`
+		if (e.resource.load(std::memory_order_relaxed) == resource) {
+			while (state != revoking) {
+				if (state == empty) {
+					// The address may have been reused by a value of another type since it was given back
+					increment();
+					e.release.store(release, std::memory_order_relaxed);
+					e.state.store(1, std::memory_order_release);
+					return &e;
+				}
+				if (e.state.compare_exchange_weak(state, state == idle ? 1 : state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+					return &e;
+				}
+			}
+		} else if (state == empty || (state == idle && _give_back(e))) {
+			increment();
+			e.resource.store(resource, std::memory_order_relaxed);
+			e.release.store(release, std::memory_order_relaxed);
+			e.state.store(1, std::memory_order_release);
+			return &e;
+		}
+		increment();
+		return nullptr;
+	}
+
+	/**
+	 * @brief Drops a reference taken with `acquire`, from any thread.
+	 */
+	static void release(entry& e) noexcept {
+		// Release, so that uses of the value happen before `revoke` gives the reference back
+		for (intptr_t state = e.state.load(std::memory_order_relaxed);;) {
+			assert(state > 0);
+			if (e.state.compare_exchange_weak(state, state == 1 ? idle : state - 1, std::memory_order_release, std::memory_order_relaxed)) {
+				return;
+			}
+		}
+	}
+
+	/**
+	 * @brief Gives back the idle references any thread keeps to `resource`.
+	 *
+	 * The shared count of `resource` then tells whether any handle still refers to it, as long as no new one can be made.
+	 */
+	static void revoke(void const* resource) noexcept {
+		size_t slot = _slot(resource);
+
+		for (cache_reference_table* table = _first(); table != nullptr; table = table->_next) {
+			entry& e = table->_entries[slot];
+
+			if (e.resource.load(std::memory_order_relaxed) == resource) {
+				_give_back(e);
+			}
+		}
+	}
+
+	/**
+	 * @brief Gives back the idle references any thread keeps to a resource for which `pred` returns true.
+	 */
+	template <typename Pred>
+	static void revoke_if(Pred&& pred) noexcept {
+		for (cache_reference_table* table = _first(); table != nullptr; table = table->_next) {
+			for (entry& e : table->_entries) {
+				if (e.state.load(std::memory_order_relaxed) == idle && pred(e.resource.load(std::memory_order_relaxed))) {
+					_give_back(e);
+				}
+			}
+		}
+	}
+
+private:
+	static constexpr size_t num_entries = 64;
+
+	struct registry {
+		std::atomic<cache_reference_table*> first{nullptr}; // Every table, linked through `_next`
+		std::mutex                          mutex; // Guards leasing tables, not walking them
+		size_t                              num_tables{0};
+		std::vector<cache_reference_table*> unused;
+	};
+
+	static registry& _registry() noexcept {
+		// Never destroyed, for threads exiting after static destruction
+		static registry& r = *new registry;
+
+		return r;
+	}
+
+	static cache_reference_table* _lease() {
+		registry&       r = _registry();
+		std::lock_guard lock{r.mutex};
+
+		if (!r.unused.empty()) {
+			cache_reference_table* table = r.unused.back();
+
+			r.unused.pop_back();
+			return table;
+		}
+		// Room for every table to be returned, so that `_return` never allocates
+		r.unused.reserve(r.num_tables + 1);
+
+		auto* table = new cache_reference_table;
+
+		// Only published once linked, so walkers never see a half-made list
+		table->_next = r.first.load(std::memory_order_relaxed);
+		r.first.store(table, std::memory_order_release);
+		++r.num_tables;
+		return table;
+	}
+
+	static void _return(cache_reference_table* table) noexcept {
+		registry&       r = _registry();
+		std::lock_guard lock{r.mutex};
+
+		// Cannot allocate, see `_lease`
+		r.unused.push_back(table);
+	}
+
+	static cache_reference_table* _first() noexcept {
+		return _registry().first.load(std::memory_order_acquire);
+	}
+
+	static size_t _slot(void const* resource) noexcept {
+		// Fibonacci hashing, as resources sit at regular strides in arrays of nodes
+		return static_cast<size_t>(uint64_t{reinterpret_cast<uintptr_t>(resource)} * 0x9E3779B97F4A7C15ull >> (64 - std::countr_zero(num_entries)));
+	}
+
+	static bool _give_back(entry& e) noexcept {
+		intptr_t state = idle;
+
+		if (!e.state.compare_exchange_strong(state, revoking, std::memory_order_acquire, std::memory_order_relaxed)) {
+			return false;
+		}
+		e.release.load(std::memory_order_relaxed)(e.resource.load(std::memory_order_relaxed));
+		e.state.store(empty, std::memory_order_release);
+		return true;
+	}
+
+	std::array<entry, num_entries> _entries{};
+	cache_reference_table*         _next{nullptr};
+};
+
+/**
+ * @brief Snapshot file of a cache's entries, which a cache maps to warm up from and deserializes entry by entry as they are looked up.
+ *
+ * The file is a header, the records, then an open-addressing table of slots locating each record by its hash,
+ * so that opening it reads the header only and a lookup touches a slot and a record. Each record is the serialized key,
+ * followed by the serialized value. Integers are in native byte order, as snapshots are meant to be reopened on the same machine.
+ */
+class cache_snapshot {
+public:
+	struct header {
+		std::array<char, 8> magic;
+		uint32_t            version;
+		uint32_t            byte_order;
+		uint64_t            entries;
+		uint64_t            num_slots; // Power of 2
+		uint64_t            slots_offset;
+	};
+
+	struct slot {
+		uint64_t hash;
+		uint64_t offset; // 0 if the slot is empty
+		uint64_t size;
+	};
+
+	static constexpr std::array<char, 8> magic{'s', 'h', 'i', 'o', 'n', 'c', 'c', 'h'};
+	static constexpr uint32_t            version = 1;
+	static constexpr uint32_t            byte_order = 0x01020304;
+
+	/**
+	 * @brief Writes a snapshot to a temporary file next to `path`, which replaces `path` once complete.
+	 */
+	class writer {
+	public:
+		explicit writer(std::filesystem::path path) :
+			_path{std::move(path)},
+			_temp_path{std::filesystem::path{_path} += ".tmp"},
+			_file{std::fopen(_temp_path.string().c_str(), "wb")} {
+			_write(header{}); // Written again by `commit`, once the slots are known
+		}
+
+		writer(writer const&) = delete;
+		writer& operator=(writer const&) = delete;
+
+		~writer() {
+			if (_file) {
+				_file.reset();
+				std::error_code ignored;
+				std::filesystem::remove(_temp_path, ignored);
+			}
+		}
+
+		/**
+		 * @brief Adds an entry, with `Key` and `Value` serialized by their `serializer_helper`.
+		 */
+		template <typename Key, typename Value>
+		void add(size_t hash, Key const& key, Value const& value) {
+			size_t key_size = static_cast<size_t>(serializer_helper<Key>{}.write({}, key));
+			size_t value_size = static_cast<size_t>(serializer_helper<Value>{}.write({}, value));
+
+			_record.resize(key_size + value_size);
+			serializer_helper<Key>{}.write(std::span{_record}.first(key_size), key);
+			serializer_helper<Value>{}.write(std::span{_record}.subspan(key_size), value);
+			add_serialized(hash, _record);
+		}
+
+		/**
+		 * @brief Adds an entry already serialized as a record, such as one of another snapshot.
+		 */
+		void add_serialized(size_t hash, std::span<std::byte const> record) {
+			_slots.push_back({hash, _offset, record.size()});
+			_write_bytes(record);
+		}
+
+		/**
+		 * @brief Writes the slots and the header, and replaces the file at the path with the snapshot. Returns false on failure.
+		 */
+		bool commit() {
+			header h{magic, version, byte_order, _slots.size(), std::bit_ceil(std::max(_slots.size() * 2, size_t{1})), 0};
+			std::vector<slot> table(h.num_slots, slot{});
+
+			for (slot const& s : _slots) {
+				for (size_t i = s.hash & (h.num_slots - 1);; i = (i + 1) & (h.num_slots - 1)) {
+					if (table[i].offset == 0) {
+						table[i] = s;
+						break;
+					}
+				}
+			}
+			_write_bytes(std::vector<std::byte>((alignof(slot) - _offset % alignof(slot)) % alignof(slot)));
+			h.slots_offset = _offset;
+			_write_bytes(std::as_bytes(std::span{table}));
+			if (!_file || std::fseek(_file.get(), 0, SEEK_SET) != 0) {
+				return false;
+			}
+			_write(h);
+
+			bool written = !_failed && std::fclose(_file.release()) == 0;
+			std::error_code error;
+
+			if (written) {
+				std::filesystem::rename(_temp_path, _path, error);
+			}
+			if (!written || error) {
+				std::filesystem::remove(_temp_path, error);
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		template <typename T>
+		void _write(T const& value) {
+			_write_bytes(std::as_bytes(std::span{&value, 1}));
+		}
+
+		void _write_bytes(std::span<std::byte const> bytes) {
+			if (_file && !bytes.empty() && std::fwrite(bytes.data(), 1, bytes.size(), _file.get()) != bytes.size()) {
+				_failed = true;
+			}
+			_offset += bytes.size();
+		}
+
+		std::filesystem::path                                _path;
+		std::filesystem::path                                _temp_path;
+		std::unique_ptr<std::FILE, decltype(io::close_file)> _file;
+		std::vector<slot>                                    _slots;
+		std::vector<std::byte>                               _record;
+		uint64_t                                             _offset{0};
+		bool                                                 _failed{false};
+	};
+
+	/**
+	 * @brief Maps the snapshot at `path`. Returns nullptr if it can't be read or is not a snapshot.
+	 *
+	 * Only the header is read: pages of the table and records are loaded as lookups touch them.
+	 * Where files can't be mapped, the whole file is read instead.
+	 */
+	static std::unique_ptr<cache_snapshot> open(std::filesystem::path const& path) {
+		auto snapshot = std::unique_ptr<cache_snapshot>{new cache_snapshot{}};
+
+#if SHION_CACHE_MAPPED_SNAPSHOTS
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0) {
+			return nullptr;
+		}
+
+		struct stat info{};
+		if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(header))) {
+			::close(fd);
+			return nullptr;
+		}
+
+		void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+		::close(fd);
+		if (data == MAP_FAILED) {
+			return nullptr;
+		}
+		// Lookups jump around the file, reading ahead would load pages nobody asked for
+		::madvise(data, static_cast<size_t>(info.st_size), MADV_RANDOM);
+		snapshot->_data = static_cast<std::byte const*>(data);
+		snapshot->_size = static_cast<size_t>(info.st_size);
+#else
+		auto f = std::unique_ptr<std::FILE, decltype(io::close_file)>{std::fopen(path.string().c_str(), "rb")};
+		std::error_code error;
+		auto size = std::filesystem::file_size(path, error);
+
+		if (!f || error || size < sizeof(header)) {
+			return nullptr;
+		}
+		snapshot->_buffer = std::make_unique_for_overwrite<std::byte[]>(size);
+		if (std::fread(snapshot->_buffer.get(), 1, size, f.get()) != size) {
+			return nullptr;
+		}
+		snapshot->_data = snapshot->_buffer.get();
+		snapshot->_size = size;
+#endif
+		std::memcpy(&snapshot->_header, snapshot->_data, sizeof(header));
+
+		header const& h = snapshot->_header;
+
+		if (h.magic != magic || h.version != version || h.byte_order != byte_order || !std::has_single_bit(h.num_slots)
+			|| h.slots_offset > snapshot->_size || (snapshot->_size - h.slots_offset) / sizeof(slot) < h.num_slots) {
+			return nullptr;
+		}
+		snapshot->_taken = std::make_unique<std::atomic<bool>[]>(h.num_slots);
+		return snapshot;
+	}
+
+	cache_snapshot(cache_snapshot const&) = delete;
+	cache_snapshot& operator=(cache_snapshot const&) = delete;
+
+	~cache_snapshot() {
+#if SHION_CACHE_MAPPED_SNAPSHOTS
+		if (_data != nullptr) {
+			::munmap(const_cast<std::byte*>(_data), _size);
+		}
+#endif
+	}
+
+	/**
+	 * @brief Calls `fn(index, record)` for each record with `hash` which was not taken, until it returns true.
+	 *
+	 * Probing stops after visiting every slot once, so that a corrupt table without an empty slot cannot loop forever.
+	 */
+	template <typename Fn>
+	void find(size_t hash, Fn&& fn) const {
+		size_t i = hash & (_header.num_slots - 1);
+
+		for (size_t probes = 0; probes < _header.num_slots; ++probes, i = (i + 1) & (_header.num_slots - 1)) {
+			slot s = _slot(i);
+
+			if (s.offset == 0) {
+				return;
+			}
+			if (s.hash == hash && !_taken[i].load(std::memory_order_relaxed) && s.offset <= _header.slots_offset
+				&& s.size <= _header.slots_offset - s.offset && fn(i, record(i))) {
+				return;
+			}
+		}
+	}
+
+	/**
+	 * @brief Returns whether the snapshot has a record with `hash`, whether it was taken since or not.
+	 */
+	bool contains(size_t hash) const noexcept {
+		size_t i = hash & (_header.num_slots - 1);
+
+		for (size_t probes = 0; probes < _header.num_slots; ++probes, i = (i + 1) & (_header.num_slots - 1)) {
+			slot s = _slot(i);
+
+			if (s.offset == 0) {
+				return false;
+			}
+			if (s.hash == hash) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Calls `fn(hash, index)` for each record which was not taken.
+	 */
+	template <typename Fn>
+	void for_each(Fn&& fn) const {
+		for (size_t i = 0; i < _header.num_slots; ++i) {
+			if (slot s = _slot(i); s.offset != 0 && !_taken[i].load(std::memory_order_relaxed)) {
+				fn(static_cast<size_t>(s.hash), i);
+			}
+		}
+	}
+
+	std::span<std::byte const> record(size_t index) const noexcept {
+		slot s = _slot(index);
+
+		return {_data + s.offset, s.size};
+	}
+
+	/**
+	 * @brief Marks the record at `index` as taken: it is not found again.
+	 */
+	void take(size_t index) noexcept {
+		_taken[index].store(true, std::memory_order_relaxed);
+	}
+
+	bool taken(size_t index) const noexcept {
+		return _taken[index].load(std::memory_order_relaxed);
+	}
+
+	size_t size() const noexcept {
+		return _header.entries;
+	}
+
+private:
+	cache_snapshot() = default;
+
+	slot _slot(size_t index) const noexcept {
+		slot s;
+
+		std::memcpy(&s, _data + _header.slots_offset + index * sizeof(slot), sizeof(slot));
+		return s;
+	}
+
+	std::byte const*                     _data{nullptr};
+	size_t                               _size{0};
+	std::unique_ptr<std::byte[]>         _buffer; // Holds the file where it can't be mapped
+	header                               _header{};
+	std::unique_ptr<std::atomic<bool>[]> _taken;
+};
+
+}
+
+/**
+ * @brief Least recently used eviction.
+ *
+ * Lookups reorder entries under a mutex of their own, but skip it if another lookup in the shard holds it:
+ * under heavy read load the order is approximate, but readers never wait on each other.
+ */
+SHION_EXPORT struct lru_eviction {
+	/**
+	 * @brief Whether `access` may run concurrently with the other members, which lock-free lookups require.
+	 */
+	static constexpr bool concurrent_access = false;
+
+	template <typename Node>
+	struct hook : detail::cache_list_hook<Node> {};
+
+	template <typename Node>
+	class policy {
+	public:
+		void insert(Node& node, size_t /* num_entries */) noexcept {
+			_list.push_front(node);
+		}
+
+		void access(Node& node) noexcept {
+			if (std::unique_lock lock{_mutex, std::try_to_lock}; lock.owns_lock()) {
+				_list.move_to_front(node);
+			}
+		}
+
+		void erase(Node& node) noexcept {
+			_list.erase(node);
+		}
+
+		template <typename Pred>
+		Node* victim(Pred& evictable) {
+			return _list.find_from_back(evictable, max_scan);
+		}
+
+	private:
+		static constexpr size_t max_scan = 16;
+
+		std::mutex                                             _mutex;
+		detail::cache_list<Node, &Node::eviction_hook> _list;
+	};
+};
+
+/**
+ * @brief CLOCK (second chance) eviction.
+ *
+ * Lookups only set a flag on the entry, so they never contend with each other. The hand sweeps entries in insertion order,
+ * clearing flags as it goes, and evicts the first entry that was not accessed since the hand last passed it.
+ */
+SHION_EXPORT struct clock_eviction {
+	static constexpr bool concurrent_access = true;
+
+	template <typename Node>
+	struct hook : detail::cache_list_hook<Node> {
+		std::atomic<bool> referenced{false};
+	};
+
+	template <typename Node>
+	class policy {
+	public:
+		void insert(Node& node, size_t /* num_entries */) noexcept {
+			node.eviction_hook.referenced.store(false, std::memory_order_relaxed);
+			// Right behind the hand, so that it comes last in its turn: in front of it, it would starve the entries the hand passed
+			if (_hand != nullptr) {
+				_list.insert_after(*_hand, node);
+			} else {
+				_list.push_front(node);
+			}
+		}
+
+		void access(Node& node) noexcept {
+			if (!node.eviction_hook.referenced.load(std::memory_order_relaxed)) {
+				node.eviction_hook.referenced.store(true, std::memory_order_relaxed);
+			}
+		}
+
+		void erase(Node& node) noexcept {
+			if (_hand == &node) {
+				_hand = _list.prev(node);
+			}
+			_list.erase(node);
+		}
+
+		template <typename Pred>
+		Node* victim(Pred& evictable) {
+			// Two turns are enough to clear every flag and come back to the first entry
+			for (size_t i = 0; i < _list.size() * 2; ++i) {
+				Node* node = _hand != nullptr ? _hand : _list.back();
+
+				_hand = _list.prev(*node);
+				if (node->eviction_hook.referenced.load(std::memory_order_relaxed)) {
+					node->eviction_hook.referenced.store(false, std::memory_order_relaxed);
+				} else if (evictable(*node)) {
+					return node;
+				}
+			}
+			return nullptr;
+		}
+
+	private:
+		Node*                                          _hand{nullptr};
+		detail::cache_list<Node, &Node::eviction_hook> _list;
+	};
+};
+
+/**
+ * @brief Window TinyLFU eviction.
+ *
+ * New entries enter a small LRU window. Entries leaving the window compete with the least recently used entry of the
+ * main space, and the one accessed less often according to a frequency sketch is evicted, which keeps one-hit wonders
+ * from flushing popular entries. The main space is a segmented LRU: entries accessed again while on probation are
+ * promoted to a protected segment holding up to 80% of it.
+ */
+SHION_EXPORT struct tiny_lfu_eviction {
+	static constexpr bool concurrent_access = false;
+
+	template <typename Node>
+	struct hook : detail::cache_list_hook<Node> {
+		uint8_t segment{0};
+	};
+
+	template <typename Node>
+	class policy {
+	public:
+		void insert(Node& node, size_t num_entries) {
+			_sketch.reserve(num_entries);
+			_sketch.age();
+			_sketch.increment(node.hash);
+			node.eviction_hook.segment = window;
+			_lists[window].push_front(node);
+		}
+
+		void access(Node& node) noexcept {
+			_sketch.increment(node.hash);
+			if (std::unique_lock lock{_mutex, std::try_to_lock}; lock.owns_lock()) {
+				_promote(node);
+			}
+		}
+
+		void erase(Node& node) noexcept {
+			_lists[node.eviction_hook.segment].erase(node);
+		}
+
+		template <typename Pred>
+		Node* victim(Pred& evictable) {
+			auto   total = _lists[window].size() + _lists[probation].size() + _lists[protect].size();
+			Node*  candidate = _lists[window].size() > std::max(total / 100, size_t{1}) ? _lists[window].find_from_back(evictable, max_scan) : nullptr;
+			Node*  main = _lists[probation].find_from_back(evictable, max_scan);
+
+			if (main == nullptr) {
+				main = _lists[protect].find_from_back(evictable, max_scan);
+			}
+			if (candidate != nullptr && main != nullptr) {
+				if (_sketch.frequency(candidate->hash) <= _sketch.frequency(main->hash)) {
+					return candidate;
+				}
+				_move(*candidate, probation);
+				return main;
+			}
+			if (candidate == nullptr && main == nullptr) {
+				return _lists[window].find_from_back(evictable, max_scan);
+			}
+			return candidate != nullptr ? candidate : main;
+		}
+
+	private:
+		static constexpr size_t  max_scan = 16;
+		static constexpr uint8_t window = 0;
+		static constexpr uint8_t probation = 1;
+		static constexpr uint8_t protect = 2;
+
+		void _move(Node& node, uint8_t segment) noexcept {
+			_lists[node.eviction_hook.segment].erase(node);
+			node.eviction_hook.segment = segment;
+			_lists[segment].push_front(node);
+		}
+
+		void _promote(Node& node) noexcept {
+			if (node.eviction_hook.segment != probation) {
+				_lists[node.eviction_hook.segment].move_to_front(node);
+				return;
+			}
+			_move(node, protect);
+			if (auto main = _lists[probation].size() + _lists[protect].size(); _lists[protect].size() * 5 > main * 4) {
+				_move(*_lists[protect].back(), probation);
+			}
+		}
+
+		std::mutex                                     _mutex;
+		detail::cache_frequency_sketch                 _sketch;
+		detail::cache_list<Node, &Node::eviction_hook> _lists[3];
+	};
+};
+
+/**
+ * @brief Construction options for `cache`.
+ */
+SHION_EXPORT struct cache_options {
+	/**
+	 * @brief Number of independently locked shards, rounded up to a power of two.
+	 */
+	size_t shards{1};
+
+	/**
+	 * @brief Maximum total weight of the entries, split evenly between shards. 0 for unbounded.
+	 *
+	 * Entries weigh 1 unless the cache is given a weigher, so by default this is an entry count.
+	 */
+	size_t capacity{0};
+
+	/**
+	 * @brief How long entries stay valid after being inserted, or after their last access if `expire_after_access` is set. 0 for forever.
+	 *
+	 * Entries inserted with `try_emplace_for` or `try_emplace_until` use their own expiry instead.
+	 */
+	std::chrono::steady_clock::duration time_to_live{0};
+
+	/**
+	 * @brief Whether finding an entry pushes back its expiry by its time to live.
+	 */
+	bool expire_after_access{false};
+
+	/**
+	 * @brief Whether to count hits, misses and the other counters of `cache_stats`.
+	 */
+	bool record_stats{false};
+
+	/**
+	 * @brief Whether `find` looks entries up without locking, so that reads scale with the number of cores.
+	 *
+	 * Writers then defer reusing removed entries until no lookup can still see them.
+	 * Lookups only record accesses for eviction policies with `concurrent_access`, such as `clock_eviction`,
+	 * so a bounded cache with lock-free reads must use one of those.
+	 */
+	bool lock_free_reads{false};
+
+	/**
+	 * @brief Whether `cached_resource` copies count their references in per-thread tables instead of the value's shared count.
+	 *
+	 * This keeps threads copying handles to the same value from contending on its count, which only pays off with
+	 * several cores hammering a few hot values: each copy then costs a table lookup, and evicting a value that was
+	 * recently used first gives back the idle references threads keep to it.
+	 */
+	bool per_thread_references{false};
+};
+
+/**
+ * @brief Snapshot of a cache's statistics, see `cache::stats`.
+ *
+ * Counters are read one at a time while the cache is in use, so they may disagree slightly with each other.
+ */
+SHION_EXPORT struct cache_stats {
+	/**
+	 * @brief Lookups which found an entry, by `find`, `try_emplace` or `get_or_load`.
+	 */
+	size_t hits{0};
+
+	/**
+	 * @brief Lookups which found no entry, or an expired one.
+	 */
+	size_t misses{0};
+
+	size_t inserts{0};
+
+	/**
+	 * @brief Entries removed to make room.
+	 */
+	size_t evictions{0};
+
+	/**
+	 * @brief Expired entries removed.
+	 */
+	size_t expirations{0};
+
+	/**
+	 * @brief Loaders of `get_or_load` that threw.
+	 */
+	size_t load_failures{0};
+
+	/**
+	 * @brief Total time spent waiting for shard locks held by other threads.
+	 */
+	std::chrono::nanoseconds lock_wait_time{0};
+
+	/**
+	 * @brief Histogram of loader run times: `load_latency[i]` counts loads which took [2^i, 2^(i + 1)) microseconds.
+	 */
+	std::array<size_t, detail::cache_counters::num_latency_buckets> load_latency{};
+
+	/**
+	 * @brief Histogram of how many references to each entry are held, not counting the cache's own.
+	 *
+	 * `references[0]` counts entries nobody holds, and `references[i]` entries held [2^(i - 1), 2^i) times.
+	 * With `per_thread_references`, a thread counts once for all the `cached_resource` it copied, and may keep counting
+	 * for a while after dropping them.
+	 */
+	std::array<size_t, 16> references{};
+
+	/**
+	 * @brief Entries in the cache when the snapshot was taken.
+	 */
+	size_t entries{0};
+
+	double hit_ratio() const noexcept {
+		return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses);
+	}
+};
+
+SHION_EXPORT template <typename Value>
+class cached_resource {
+	template <typename, typename, typename, typename, typename>
+	friend class cache;
+
+	using resource = detail::shared_cached_resource<Value>;
+
+	friend resource;
+
+	using value_t = typename resource::value_t;
+
+	// Takes a reference directly in the shared count, for the cache's own
+	cached_resource(resource& res) noexcept :
+		ptr{&res} {
+		ptr->increment();
+	}
+
+public:
+	friend class cached_resource<std::add_const_t<Value>>;
+
+	cached_resource() noexcept = default;
+
+	cached_resource(const cached_resource &other) noexcept :
+		ptr{other.ptr} {
+		_acquire();
+	}
+
+	cached_resource(const cached_resource<std::remove_const_t<Value>> &other) noexcept
+		requires(std::is_const_v<Value>) :
+		ptr{other.ptr} {
+		_acquire();
+	}
+
+	cached_resource(cached_resource&& rhs) noexcept :
+		ptr{std::exchange(rhs.ptr, nullptr)},
+		entry{std::exchange(rhs.entry, nullptr)}
+	{}
+
+	~cached_resource() {
+		_release();
+	}
+
+	cached_resource &operator=(const cached_resource &other) noexcept {
+		if (this != &other) {
+			release();
+			ptr = other.ptr;
+			_acquire();
+		}
+		return *this;
+	}
+
+	cached_resource &operator=(cached_resource &&other) noexcept {
+		if (this != &other) {
+			release();
+			ptr = std::exchange(other.ptr, nullptr);
+			entry = std::exchange(other.entry, nullptr);
+		}
+		return *this;
+	}
+
+	constexpr explicit operator bool() const noexcept {
+		return ptr;
+	}
+
+	[[nodiscard]] auto operator*() const noexcept -> std::add_lvalue_reference_t<std::add_const_t<Value>> {
+		assert(ptr);
+
+		if constexpr (std::is_reference_v<Value>) {
+			return *ptr->get();
+		} else {
+			return ptr->get();
+		}
+	}
+
+	[[nodiscard]] auto operator*() noexcept -> std::add_lvalue_reference_t<Value>{
+		assert(ptr);
+
+		if constexpr (std::is_reference_v<Value>) {
+			return *ptr->get();
+		} else {
+			return ptr->get();
+		}
+	}
+
+	std::add_pointer_t<Value> operator->() noexcept {
+		assert(ptr);
+
+		return &ptr->get();
+	}
+
+	std::add_pointer_t<std::add_const_t<Value>> *operator->() const noexcept {
+		assert(ptr);
+
+		return &ptr->operator*();
+	}
+
+	std::add_const_t<value_t> &get() const {
+		cached_resource const& self = *this;
+		if (!self) {
+			throw std::bad_optional_access{};
+		}
+		return self.operator*();
+	}
+
+	value_t& get() {
+		cached_resource& self = *this;
+		if (!self) {
+			throw std::bad_optional_access{};
+		}
+		return self.operator*();
+	}
+
+	void release() noexcept {
+		_release();
+		ptr = nullptr;
+		entry = nullptr;
+	}
+
+private:
+	using reference_table = detail::cache_reference_table;
+
+	// Counts the reference in the calling thread's table if the cache asked for it, so that threads copying the same handle don't contend
+	void _acquire() noexcept {
+		if (ptr && ptr->per_thread_references()) {
+			entry = reference_table::local().acquire(ptr, &_release_shared, [res = ptr] { res->increment(); });
+		} else if (ptr) {
+			ptr->increment();
+		}
+	}
+
+	void _release() noexcept {
+		if (entry) {
+			reference_table::release(*entry);
+		} else if (ptr) {
+			ptr->decrement();
+		}
+	}
+
+	static void _release_shared(void const* res) noexcept {
+		const_cast<resource*>(static_cast<resource const*>(res))->decrement();
+	}
+
+	resource*               ptr = nullptr;
+	reference_table::entry* entry = nullptr; // Null if counted directly in `ptr`
+};
+
+template <typename Value>
+requires (!std::is_reference_v<Value> && !std::is_const_v<Value>)
+template <typename... Args>
+[[nodiscard]] cached_resource<Value> detail::stored_cache_resource<Value>::emplace(Args&&... args)
+noexcept(std::is_nothrow_constructible_v<std::remove_cvref_t<Value>, Args...>) {
+	assert(ref_count == 0);
+	std::construct_at(
+		&v,
+		std::forward<Args>(args)...
+	);
+	return {*this};
+}
+
+/**
+ * @brief Thread-safe cache of reference-counted values.
+ *
+ * Entries can expire: a lookup treats an expired entry as missing, and the entry is removed by the next insert of its key
+ * or by `sweep`. An expired or evicted entry's value stays alive for as long as someone holds a `cached_resource` to it.
+ *
+ * @tparam Eviction Policy choosing which entries to evict once a bounded cache is over capacity,
+ * see `lru_eviction`, `clock_eviction` and `tiny_lfu_eviction`.
+ */
+SHION_EXPORT template <typename Key, typename Value, typename Hasher, typename Equal, typename Eviction = lru_eviction>
+class cache {
+private:
+	using clock = std::chrono::steady_clock;
+
+public:
+	using weigher_t = std::function<size_t(Key const&, Value const&)>;
+
+	cache() : cache(1) {}
+
+	/**
+	 * @brief Creates a cache split into `num_shards` independently locked shards, rounded up to a power of two.
+	 *
+	 * Each key is owned by the shard selected by its hash, so operations on keys in different shards never contend.
+	 */
+	explicit cache(size_t num_shards) :
+		cache(cache_options{.shards = num_shards}) {
+	}
+
+	/**
+	 * @brief Creates a cache with the given options.
+	 *
+	 * When the cache has a capacity, inserting into a shard over its share of it evicts entries chosen by `Eviction`.
+	 * Only entries nobody else holds a `cached_resource` to are evicted, so a shard can stay over capacity while its entries are in use.
+	 *
+	 * @param weigher Returns the weight of an entry, counted against the capacity. Each entry weighs 1 if empty.
+	 * @throws std::invalid_argument If `options` asks for lock-free reads on a bounded cache whose `Eviction` lacks `concurrent_access`.
+	 */
+	explicit cache(cache_options const& options, weigher_t weigher = {}) :
+		_num_shards{std::bit_ceil(std::max(options.shards, size_t{1}))},
+		_shard_shift{static_cast<unsigned>(std::numeric_limits<size_t>::digits - std::countr_zero(_num_shards))},
+		_shard_capacity{(options.capacity + _num_shards - 1) / _num_shards},
+		_time_to_live{options.time_to_live},
+		_expire_after_access{options.expire_after_access},
+		_per_thread_references{options.per_thread_references},
+		_weigher{std::move(weigher)},
+		_shards{std::make_unique<shard[]>(_num_shards)},
+		_counters{options.record_stats ? std::make_unique<detail::cache_counters>() : nullptr},
+		_epoch{options.lock_free_reads ? std::make_unique<detail::cache_epoch>() : nullptr} {
+		if (options.lock_free_reads && options.capacity > 0 && !Eviction::concurrent_access) {
+			throw std::invalid_argument{"lock-free reads on a bounded cache need an eviction policy with concurrent_access"};
+		}
+
+		for (shard& s : std::span{_shards.get(), _num_shards}) {
+			s.index.set_concurrent_readers(options.lock_free_reads);
+		}
+	}
+
+	~cache() {
+		// Threads may keep idle references to our values, which must be given back before the nodes go
+		if (_per_thread_references) {
+			detail::cache_reference_table::revoke_if([this](void const* resource) noexcept {
+				return _owns(resource);
+			});
+		}
+	}
+
+	cache(const cache&) = delete;
+	cache(cache&&) = delete;
+	cache &operator=(const cache&) = delete;
+	cache &operator=(cache&&) = delete;
+
+	using element_t = std::pair<Key, Value>;
+	using value_t = cached_resource<Value>;
+
+	template <typename T>
+	static inline constexpr auto nothrow_hash = noexcept(Hasher{}(std::declval<T>()));
+
+	template <typename T>
+	static inline constexpr auto nothrow_equal = noexcept(Equal{}(std::declval<Key const&>(), std::declval<T>()));
+
+	template <typename T>
+	static inline constexpr auto nothrow_lookup = noexcept(nothrow_hash<T> && nothrow_equal<T>);
+
+	template <typename T, typename... Args>
+	static inline constexpr auto nothrow_emplace = std::is_nothrow_constructible_v<Key, T> && std::is_nothrow_constructible_v<Value, Args...>;
+
+	/**
+	 * @brief Whether `find` looks up keys of type `T` as they are, which requires both `Hasher` and `Equal` to be transparent.
+	 *
+	 * Otherwise, the key is converted to `Key` once, rather than by each call to the hasher and the comparator.
+	 */
+	template <typename T>
+	static inline constexpr bool transparent_lookup = std::is_same_v<std::remove_cvref_t<T>, Key>
+		|| (requires { typename Hasher::is_transparent; } && requires { typename Equal::is_transparent; });
+
+	/**
+	 * @brief Whether the entries can be saved to a snapshot and read back, which requires `serializer_helper` to support both keys and values.
+	 */
+	static inline constexpr bool snapshot_serializable = serializable<Key> && serializable<Value>
+		&& deserialize_readable<Key> && deserialize_readable<Value>
+		&& deserialize_constructible<Key> && deserialize_constructible<Value>;
+
+	/**
+	 * @brief Whether looking up keys of type `T` can throw.
+	 *
+	 * Lookups in a cache that can open a snapshot may deserialize and insert the entry they find there, which can throw.
+	 */
+	template <typename T>
+	static inline constexpr auto nothrow_find = !snapshot_serializable && (transparent_lookup<T>
+		? nothrow_lookup<T const&>
+		: nothrow_lookup<Key const&> && std::is_nothrow_constructible_v<Key, T const&>);
+
+	/**
+	 * @brief Maximum amount of entries `sweep` looks at while holding a shard's lock.
+	 */
+	static inline constexpr size_t sweep_batch = 64;
+
+	/**
+	 * @brief With lock-free reads, how many removed entries a shard accumulates before waiting for lookups to let go of them.
+	 */
+	static inline constexpr size_t retire_batch = 64;
+
+private:
+	using resource = typename cached_resource<Value>::resource;
+	using counter = detail::cache_counters::counter;
+
+	static inline constexpr auto never = std::numeric_limits<clock::rep>::max();
+
+	struct expiry {
+		clock::rep deadline{never};
+		clock::rep time_to_live{0}; // Non-zero if accesses push back the deadline
+	};
+
+	struct node {
+		size_t hash{0};
+		size_t weight{0};
+		std::pair<Key, resource> elem;
+		cached_resource<Value> my_ref;
+		typename Eviction::template hook<node> eviction_hook;
+		std::atomic<clock::rep> deadline{never};
+		clock::rep time_to_live{0};
+		bool linked{false}; // Whether the node is in the index, otherwise it is free or waiting for its last user to let go
+		bool retired{false}; // Whether lock-free lookups may still be looking at the node after it was unlinked
+	};
+
+	/**
+	 * @brief Load of a missing entry by `get_or_load`, shared by every caller asking for the same key while it runs.
+	 */
+	struct pending_load {
+		pending_load(size_t hash_, Key&& key_) : hash{hash_}, key{std::move(key_)} {}
+
+		/**
+		 * @brief Publishes the result and wakes every waiter. Coroutines are resumed on the calling thread.
+		 */
+		void complete(cached_resource<Value> value, std::exception_ptr exception = {}) {
+			std::vector<std::coroutine_handle<>> to_resume;
+			{
+				std::lock_guard lock{mutex};
+				result = std::move(value);
+				error = std::move(exception);
+				done = true;
+				to_resume = std::move(waiters);
+			}
+			cv.notify_all();
+			for (std::coroutine_handle<> handle : to_resume) {
+				handle.resume();
+			}
+		}
+
+		cached_resource<Value> wait() {
+			std::unique_lock lock{mutex};
+			cv.wait(lock, [this] { return done; });
+			lock.unlock();
+			return get();
+		}
+
+		cached_resource<Value> get() const {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+			return result;
+		}
+
+		size_t hash;
+		Key key;
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool done{false};
+		cached_resource<Value> result;
+		std::exception_ptr error;
+		std::vector<std::coroutine_handle<>> waiters;
+	};
+
+	struct bucket {
+		static constexpr size_t num_elements = std::max(32ull, (32ull * 1024 / (sizeof(node))));
+		using storage = std::array<node, num_elements>;
+		using storage_iterator = std::ranges::iterator_t<storage>;
+
+		constexpr auto begin() {
+			return data.begin();
+		}
+
+		constexpr auto begin() const {
+			return data.begin();
+		}
+
+		constexpr auto end() {
+			return data.end();
+		}
+
+		constexpr auto end() const {
+			return data.end();
+		}
+
+		std::array<node, num_elements> data{};
+	};
+
+	// Padded to a cache line so that locking one shard doesn't invalidate its neighbor's mutex
+	struct alignas(64) shard {
+		mutable std::shared_mutex mutex;
+		std::vector<std::unique_ptr<bucket>> buckets;
+		detail::cache_index<node> index;
+		std::vector<node*> free_nodes;
+		size_t weight{0};
+		size_t sweep_cursor{0};
+		typename Eviction::template policy<node> eviction;
+		std::vector<std::shared_ptr<pending_load>> loads; // Few at a time, so a linear scan beats a map
+		std::vector<node*> retired;
+	};
+
+	/**
+	 * @brief Awaits the completion of a `pending_load`, suspending the awaiting coroutine until then.
+	 */
+	struct load_awaiter {
+		std::shared_ptr<pending_load> load;
+
+		bool await_ready() const {
+			std::lock_guard lock{load->mutex};
+			return load->done;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) {
+			std::lock_guard lock{load->mutex};
+			if (load->done) {
+				return false;
+			}
+			load->waiters.push_back(handle);
+			return true;
+		}
+
+		cached_resource<Value> await_resume() const {
+			return load->get();
+		}
+	};
+
+	/**
+	 * @brief Result of looking up a key for `get_or_load`: either the cached value, or the load to wait for and whether the caller must run it.
+	 */
+	struct load_ticket {
+		cached_resource<Value> found;
+		std::shared_ptr<pending_load> load;
+		bool owner{false};
+	};
+
+public:
+	template <typename T>
+	cached_resource<Value> find(const T& key) noexcept(nothrow_find<T>) {
+		if constexpr (transparent_lookup<T>) {
+			return find_hash(key, hash(key));
+		} else {
+			Key converted(key);
+
+			return find_hash(converted, hash(converted));
+		}
+	}
+
+	template <typename T>
+	cached_resource<std::add_const_t<Value>> find(const T& key) const noexcept(nothrow_find<T>) {
+		return const_cast<cache*>(this)->find(key);
+	}
+
+	/**
+	 * @brief Finds each of `keys`, returning their values in the same order, or empty ones for keys that are missing.
+	 *
+	 * Every key is hashed first, then each shard is visited once: its lock is taken a single time for all of its keys,
+	 * and the index groups of upcoming keys are prefetched while probing the current one, so that their cache misses overlap.
+	 */
+	template <typename T>
+	std::vector<cached_resource<Value>> find_many(std::span<T> keys) {
+		if constexpr (transparent_lookup<T>) {
+			std::vector<size_t> hashes(keys.size());
+
+			std::ranges::transform(keys, hashes.begin(), [this](T const& key) { return hash(key); });
+			return find_many(keys, std::span<size_t const>{hashes});
+		} else {
+			std::vector<Key> converted(keys.begin(), keys.end());
+
+			return find_many(std::span<Key const>{converted});
+		}
+	}
+
+	/**
+	 * @brief Like `find_many`, with the hashes of the keys already computed, as returned by `hash`.
+	 */
+	template <typename T>
+	std::vector<cached_resource<Value>> find_many(std::span<T> keys, std::span<size_t const> hashes) {
+		assert(keys.size() == hashes.size());
+
+		std::vector<cached_resource<Value>> found(keys.size());
+		std::vector<size_t>                 order(keys.size());
+		std::vector<size_t>                 shard_begin(_num_shards + 1, 0);
+
+		// Group the keys by shard with a counting sort, keeping their order within a shard
+		for (size_t hash : hashes) {
+			++shard_begin[_shard_index(hash) + 1];
+		}
+		std::partial_sum(shard_begin.begin(), shard_begin.end(), shard_begin.begin());
+		{
+			std::vector<size_t> next(shard_begin.begin(), shard_begin.end() - 1);
+
+			for (size_t i = 0; i < keys.size(); ++i) {
+				order[next[_shard_index(hashes[i])]++] = i;
+			}
+		}
+		for (size_t i = 0; i < _num_shards; ++i) {
+			if (shard_begin[i] != shard_begin[i + 1]) {
+				_find_batch(_shards[i], keys, hashes, std::span{order}.subspan(shard_begin[i], shard_begin[i + 1] - shard_begin[i]), found);
+			}
+		}
+		return found;
+	}
+
+	template <typename T>
+	cached_resource<Value> find_hash(const T& key, size_t hash) noexcept(nothrow_equal<T> && !snapshot_serializable) {
+		cached_resource<Value> found = _find_ref(_shard_for(hash), key, hash);
+
+		if (!found && _snapshot) {
+			found = _find_in_snapshot(_shard_for(hash), key, hash);
+		}
+		_count(found ? counter::hits : counter::misses);
+		return found;
+	}
+
+	template <typename T>
+	cached_resource<std::add_const_t<Value>> find_hash(const T& key, size_t hash) const noexcept(nothrow_equal<T> && !snapshot_serializable) {
+		return const_cast<cache*>(this)->find_hash(key, hash);
+	}
+
+	template <typename T, typename... Args>
+	std::pair<cached_resource<Value>, bool> try_emplace(T&& key, Args&&... args) noexcept(nothrow_lookup<T> && nothrow_emplace<T, Args...>) {
+		return _try_emplace(_default_expiry(), std::forward<T>(key), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * @brief Like `try_emplace`, but a newly inserted entry expires at `deadline`.
+	 */
+	template <typename T, typename... Args>
+	std::pair<cached_resource<Value>, bool> try_emplace_until(clock::time_point deadline, T&& key, Args&&... args) noexcept(nothrow_lookup<T> && nothrow_emplace<T, Args...>) {
+		return _try_emplace(expiry{deadline.time_since_epoch().count()}, std::forward<T>(key), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * @brief Like `try_emplace`, but a newly inserted entry expires after `time_to_live`, counted from its last access if the cache expires after access.
+	 */
+	template <typename T, typename... Args>
+	std::pair<cached_resource<Value>, bool> try_emplace_for(clock::duration time_to_live, T&& key, Args&&... args) noexcept(nothrow_lookup<T> && nothrow_emplace<T, Args...>) {
+		return _try_emplace(_expiry_for(time_to_live), std::forward<T>(key), std::forward<Args>(args)...);
+	}
+
+	template <typename T>
+	requires (std::is_constructible_v<Key, T> && std::is_default_constructible_v<Value>)
+	cached_resource<Value> operator[](T&& key) noexcept (nothrow_lookup<T> && nothrow_emplace<T>) {
+		return _try_emplace(_default_expiry(), std::forward<T>(key)).first;
+	}
+
+	/**
+	 * @brief Finds `key`, or inserts the value returned by `loader()` if it is missing.
+	 *
+	 * Unlike `try_emplace`, the value is created outside of the shard's lock, so lookups of other keys are not held up by a slow loader.
+	 * Concurrent calls for the same key share a single load: one caller runs its loader while the others wait for its result,
+	 * and if the loader throws, every one of them gets the exception and nothing is inserted.
+	 * The loader must not look up its own key through `get_or_load`, which would wait for itself.
+	 */
+	template <typename T, typename Loader>
+	requires (std::is_constructible_v<Key, T> && std::is_constructible_v<Value, std::invoke_result_t<Loader&>>)
+	cached_resource<Value> get_or_load(T&& key, Loader&& loader) {
+		size_t hashed = hash(key);
+		shard& s = _shard_for(hashed);
+		load_ticket ticket = _join_load(s, std::forward<T>(key), hashed);
+
+		if (!ticket.load) {
+			return ticket.found;
+		}
+		if (ticket.owner) {
+			auto start = _counters ? clock::now() : clock::time_point{};
+
+			try {
+				cached_resource<Value> loaded = _finish_load(s, *ticket.load, std::invoke(loader));
+
+				_count_load(start);
+				ticket.load->complete(std::move(loaded));
+			} catch (...) {
+				_abandon_load(s, *ticket.load);
+				ticket.load->complete({}, std::current_exception());
+			}
+		}
+		return ticket.load->wait();
+	}
+
+	/**
+	 * @brief Coroutine version of `get_or_load`, which suspends instead of blocking while another caller loads the same key.
+	 *
+	 * `loader()` may return either the value, or an awaitable producing it, such as a `task`, which is then `co_await`-ed.
+	 * Waiters are resumed on the thread that finishes the load. The cache must outlive the returned task.
+	 */
+	template <typename Loader>
+	task<cached_resource<Value>> get_or_load_async(Key key, Loader loader) {
+		size_t hashed = hash(key);
+		shard& s = _shard_for(hashed);
+		load_ticket ticket = _join_load(s, std::move(key), hashed);
+
+		if (!ticket.load) {
+			co_return ticket.found;
+		}
+		if (ticket.owner) {
+			auto               start = _counters ? clock::now() : clock::time_point{};
+			std::exception_ptr error;
+
+			try {
+				cached_resource<Value> loaded;
+
+				if constexpr (std::is_constructible_v<Value, std::invoke_result_t<Loader&>>) {
+					loaded = _finish_load(s, *ticket.load, std::invoke(loader));
+				} else {
+					loaded = _finish_load(s, *ticket.load, co_await std::invoke(loader));
+				}
+				_count_load(start);
+				ticket.load->complete(std::move(loaded));
+			} catch (...) {
+				error = std::current_exception();
+			}
+			if (error) {
+				_abandon_load(s, *ticket.load);
+				ticket.load->complete({}, std::move(error));
+			}
+		}
+		load_awaiter awaiter{std::move(ticket.load)};
+
+		co_return co_await awaiter;
+	}
+
+	template <typename T>
+	size_t hash(const T& key) const noexcept(nothrow_hash<const T&>) {
+		return Hasher{}(key);
+	}
+
+	/**
+	 * @brief Removes expired entries, looking at up to `max_entries` entries. Returns the number of entries removed.
+	 *
+	 * Each call resumes where the previous one stopped, so calling this periodically with a small budget,
+	 * for example from a worker or a coroutine loop, eventually visits every entry.
+	 * Shards are locked for at most `sweep_batch` entries at a time, so lookups are never held up for the whole scan.
+	 * This is also what releases the storage of expired entries that were still in use when they were removed.
+	 */
+	size_t sweep(size_t max_entries) {
+		size_t removed = 0;
+
+		for (size_t i = 0; i < _num_shards && max_entries > 0; ++i) {
+			shard& s = _shards[_sweep_shard.fetch_add(1, std::memory_order_relaxed) & (_num_shards - 1)];
+			size_t scanned = 0;
+
+			while (max_entries > 0) {
+				auto   lock = _lock<std::unique_lock>(s);
+				size_t total = s.buckets.size() * bucket::num_elements;
+				size_t batch = std::min({sweep_batch, max_entries, total - std::min(scanned, total)});
+				auto   now = clock::now().time_since_epoch().count();
+
+				if (batch == 0) {
+					break;
+				}
+				for (size_t j = 0; j < batch; ++j, s.sweep_cursor = (s.sweep_cursor + 1) % total) {
+					node& n = s.buckets[s.sweep_cursor / bucket::num_elements]->data[s.sweep_cursor % bucket::num_elements];
+
+					if (n.linked && n.deadline.load(std::memory_order_relaxed) <= now) {
+						_unlink(s, n);
+						_count(counter::expirations);
+						++removed;
+					} else if (!n.linked && !n.retired && n.my_ref && _unused(n)) {
+						_reclaim(s, n);
+					}
+				}
+				scanned += batch;
+				max_entries -= batch;
+			}
+			if (_epoch) {
+				auto lock = _lock<std::unique_lock>(s);
+
+				_collect(s);
+			}
+		}
+		return removed;
+	}
+
+	/**
+	 * @brief Returns a snapshot of the cache's statistics.
+	 *
+	 * The counters stay at 0 unless the cache was created with `cache_options::record_stats`.
+	 * The entry count and the reference histogram are computed by visiting every entry, one shard at a time.
+	 */
+	cache_stats stats() const {
+		cache_stats result;
+
+		if (_counters) {
+			result.hits = _counters->total(counter::hits);
+			result.misses = _counters->total(counter::misses);
+			result.inserts = _counters->total(counter::inserts);
+			result.evictions = _counters->total(counter::evictions);
+			result.expirations = _counters->total(counter::expirations);
+			result.load_failures = _counters->total(counter::load_failures);
+			result.lock_wait_time = std::chrono::nanoseconds{_counters->total(counter::lock_wait_ns)};
+			result.load_latency = _counters->load_latency();
+		}
+		for (shard& s : std::span{_shards.get(), _num_shards}) {
+			std::shared_lock lock{s.mutex};
+
+			for (auto const& b : s.buckets) {
+				for (node const& n : b->data) {
+					if (!n.linked) {
+						continue;
+					}
+					// Not counting the cache's own reference
+					size_t references = n.elem.second.use_count() - 1;
+
+					++result.references[std::min(static_cast<size_t>(std::bit_width(references)), result.references.size() - 1)];
+				}
+			}
+			result.entries += s.index.size();
+		}
+		return result;
+	}
+
+	/**
+	 * @brief Writes the entries to a snapshot file at `path`, which `open_snapshot` can warm up a cache from. Returns false if it couldn't be written.
+	 *
+	 * Keys and values are written by their `serializer_helper`, along with their hash, so the cache opening the snapshot must hash keys the same way.
+	 * Expired entries are skipped, and the entries of an open snapshot that were not looked up yet are copied as they are.
+	 * Shards are locked one at a time while their entries are written, so the snapshot is consistent shard by shard, not as a whole.
+	 */
+	bool save_snapshot(std::filesystem::path const& path) const requires (snapshot_serializable) {
+		detail::cache_snapshot::writer                     out{path};
+		std::vector<std::vector<std::pair<size_t, size_t>>> unread(_snapshot ? _num_shards : 0); // Hash and index of records, by shard
+
+		if (_snapshot) {
+			_snapshot->for_each([&](size_t hash, size_t index) {
+				unread[_shard_index(hash)].emplace_back(hash, index);
+			});
+		}
+		for (size_t i = 0; i < _num_shards; ++i) {
+			shard& s = _shards[i];
+			auto   lock = _lock<std::shared_lock>(s);
+			auto   now = clock::now().time_since_epoch().count();
+
+			for (auto const& b : s.buckets) {
+				for (node& n : b->data) {
+					if (n.linked && n.deadline.load(std::memory_order_relaxed) > now) {
+						out.add(n.hash, n.elem.first, n.elem.second.get());
+					}
+				}
+			}
+			// Checked under the lock, as records are taken under it
+			for (auto [hash, index] : _snapshot ? std::span{unread[i]} : std::span<std::pair<size_t, size_t>>{}) {
+				if (!_snapshot->taken(index)) {
+					out.add_serialized(hash, _snapshot->record(index));
+				}
+			}
+		}
+		return out.commit();
+	}
+
+	/**
+	 * @brief Warms up the cache from the snapshot at `path`, written by `save_snapshot`. Returns false, leaving the cache as it was, if it isn't a readable snapshot.
+	 *
+	 * The file is mapped rather than read, and its entries are deserialized one at a time, when they are first looked up
+	 * or inserted: opening is immediate, and a restarting process only pays for the entries it uses. They then get the
+	 * cache's default expiry, and count against its capacity. `size` only counts the entries that were deserialized.
+	 * The file must come from a trusted source, and not be modified while open. Any snapshot opened before is closed.
+	 * This must not be called while other threads use the cache.
+	 */
+	bool open_snapshot(std::filesystem::path const& path) requires (snapshot_serializable) {
+		std::unique_ptr<detail::cache_snapshot> snapshot = detail::cache_snapshot::open(path);
+
+		if (!snapshot) {
+			return false;
+		}
+		_snapshot = std::move(snapshot);
+		return true;
+	}
+
+	size_t shards() const noexcept {
+		return _num_shards;
+	}
+
+	/**
+	 * @brief Returns the maximum total weight of the entries, or 0 if the cache is unbounded.
+	 */
+	size_t capacity() const noexcept {
+		return _shard_capacity * _num_shards;
+	}
+
+	/**
+	 * @brief Returns the number of entries, including expired entries that were not removed yet.
+	 */
+	size_t size() const {
+		size_t total = 0;
+
+		for (shard& s : std::span{_shards.get(), _num_shards}) {
+			std::shared_lock lock{s.mutex};
+
+			total += s.index.size();
+		}
+		return total;
+	}
+
+private:
+	size_t _shard_index(size_t hash) const noexcept {
+		// Fibonacci hashing spreads the high bits of the hash over shards, leaving the low bits for lookups within a shard
+		return _num_shards == 1 ? 0 : (hash * 0x9E3779B97F4A7C15ull) >> _shard_shift;
+	}
+
+	shard& _shard_for(size_t hash) const noexcept {
+		return _shards[_shard_index(hash)];
+	}
+
+	/**
+	 * @brief Finds the keys of `keys` at `indices`, which all belong to `s`, under a single lock or epoch.
+	 */
+	template <typename T>
+	void _find_batch(shard& s, std::span<T> keys, std::span<size_t const> hashes, std::span<size_t const> indices, std::span<cached_resource<Value>> found) {
+		// Far enough ahead to cover the latency of a miss, close enough for the prefetched lines to still be in cache
+		constexpr size_t prefetch_distance = 8;
+
+		auto resolve = [&] {
+			for (size_t i = 0; i < std::min(prefetch_distance, indices.size()); ++i) {
+				s.index.prefetch(hashes[indices[i]]);
+			}
+			for (size_t i = 0; i < indices.size(); ++i) {
+				if (i + prefetch_distance < indices.size()) {
+					s.index.prefetch(hashes[indices[i + prefetch_distance]]);
+				}
+
+				size_t idx = indices[i];
+				node*  n = _find_node(s, keys[idx], hashes[idx]);
+
+				if (n != nullptr && _access(s, *n)) {
+					found[idx] = n->my_ref;
+				}
+			}
+		};
+
+		if (_epoch) {
+			detail::cache_epoch::guard guard{*_epoch};
+
+			resolve();
+		} else {
+			auto lock = _lock<std::shared_lock>(s);
+
+			resolve();
+		}
+		for (size_t idx : indices) {
+			if (!found[idx] && _snapshot) {
+				found[idx] = _find_in_snapshot(s, keys[idx], hashes[idx]);
+			}
+			_count(found[idx] ? counter::hits : counter::misses);
+		}
+	}
+
+	expiry _expiry_for(clock::duration time_to_live) const noexcept {
+		if (time_to_live <= clock::duration::zero()) {
+			return {};
+		}
+		return {(clock::now() + time_to_live).time_since_epoch().count(), _expire_after_access ? time_to_live.count() : 0};
+	}
+
+	expiry _default_expiry() const noexcept {
+		return _expiry_for(_time_to_live);
+	}
+
+	/**
+	 * @brief Locks the shard, timing the wait if another thread holds it and statistics are recorded.
+	 */
+	template <template <typename> typename Lock>
+	Lock<std::shared_mutex> _lock(shard& s) const {
+		Lock<std::shared_mutex> lock{s.mutex, std::try_to_lock};
+
+		if (!lock.owns_lock()) {
+			if (_counters) {
+				auto start = clock::now();
+
+				lock.lock();
+				_counters->add(counter::lock_wait_ns, static_cast<size_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count()));
+			} else {
+				lock.lock();
+			}
+		}
+		return lock;
+	}
+
+	void _count(counter c, size_t amount = 1) const noexcept {
+		if (_counters) {
+			_counters->add(c, amount);
+		}
+	}
+
+	void _count_load(clock::time_point start) const noexcept {
+		if (_counters) {
+			_counters->add_load(clock::now() - start);
+		}
+	}
+
+	/**
+	 * @brief Looks up `key` and records the access, without locking the shard if reads are lock-free.
+	 */
+	template <typename T>
+	cached_resource<Value> _find_ref(shard& s, const T& key, size_t hash) noexcept(nothrow_equal<T>) {
+		if (_epoch) {
+			detail::cache_epoch::guard guard{*_epoch};
+			node*                      found = _find_node(s, key, hash);
+
+			return found != nullptr && _access(s, *found) ? found->my_ref : cached_resource<Value>{};
+		}
+
+		auto  lock = _lock<std::shared_lock>(s);
+		node* found = _find_node(s, key, hash);
+
+		return found != nullptr && _access(s, *found) ? found->my_ref : cached_resource<Value>{};
+	}
+
+	template <typename T>
+	node* _find_node(shard& s, const T& key, size_t hash) noexcept(nothrow_equal<T>) {
+		return s.index.find(hash, [&key, hash](node& n) noexcept(nothrow_equal<T>) {
+			return n.hash == hash && Equal{}(n.elem.first, key);
+		});
+	}
+
+	/**
+	 * @brief Looks up a key missing from the cache in the open snapshot, inserting its entry if found.
+	 */
+	template <typename T>
+	cached_resource<Value> _find_in_snapshot(shard& s, const T& key, size_t hash) {
+		// Without locking for keys the snapshot never had. Others take the lock even if their record was taken:
+		// a lookup racing ours may have inserted the entry after we missed it, which the lock lets us see.
+		if (!_snapshot->contains(hash)) {
+			return {};
+		}
+
+		auto lock = _lock<std::unique_lock>(s);
+
+		if (node* found = _find_node(s, key, hash); found != nullptr) {
+			return _access(s, *found) ? found->my_ref : cached_resource<Value>{};
+		}
+		return _materialize(s, key, hash);
+	}
+
+	/**
+	 * @brief Deserializes the entry of the open snapshot with `key` into the cache, which must not have it. The shard must be locked.
+	 *
+	 * Each entry of the snapshot is inserted once: after that, it lives and dies in the cache like any other.
+	 * A record too short for the key or value it should hold is treated as missing.
+	 * Exceptions from deserializing or inserting the entry propagate, leaving it in the snapshot.
+	 */
+	template <typename T>
+	cached_resource<Value> _materialize(shard& s, const T& key, size_t hash) {
+		cached_resource<Value> inserted;
+
+		if constexpr (snapshot_serializable) {
+			_snapshot->find(hash, [&](size_t index, std::span<std::byte const> record) {
+				if (!_holds_serialized<Key>(record)) {
+					return false;
+				}
+
+				Key stored = serializer_helper<Key>{}.construct(record);
+
+				if (!Equal{}(stored, key)) {
+					return false;
+				}
+				if (_holds_serialized<Value>(record)) {
+					inserted = _emplace(s, _default_expiry(), std::move(stored), hash, serializer_helper<Value>{}.construct(record));
+					_snapshot->take(index);
+				}
+				return true;
+			});
+		}
+		return inserted;
+	}
+
+	/**
+	 * @brief Whether `bytes` start with a whole serialized `U`, so that constructing one from them stays in bounds.
+	 */
+	template <typename U>
+	static bool _holds_serialized(std::span<std::byte const> bytes) {
+		ptrdiff_t size = serializer_helper<U>{}.size(bytes);
+
+		return size > 0 && size <= std::ssize(bytes);
+	}
+
+	/**
+	 * @brief Records an access to `n`. Returns false if it expired.
+	 */
+	bool _access(shard& s, node& n) noexcept {
+		if (auto deadline = n.deadline.load(std::memory_order_relaxed); deadline != never) {
+			auto now = clock::now().time_since_epoch().count();
+
+			if (deadline <= now) {
+				return false;
+			}
+			if (n.time_to_live != 0) {
+				n.deadline.store(now + n.time_to_live, std::memory_order_relaxed);
+			}
+		}
+		// Lock-free lookups can't synchronize with writers updating the policy, unless it was made for it
+		if (_shard_capacity > 0 && (!_epoch || Eviction::concurrent_access)) {
+			s.eviction.access(n);
+		}
+		return true;
+	}
+
+	template <typename T, typename... Args>
+	std::pair<cached_resource<Value>, bool> _try_emplace(expiry const& expires, T&& key, Args&&... args) noexcept(nothrow_lookup<T> && nothrow_emplace<T, Args...>) {
+		size_t hashed = hash(key);
+		shard& s = _shard_for(hashed);
+		auto   lock = _lock<std::unique_lock>(s);
+
+		if (node* found = _find_node(s, key, hashed); found != nullptr) {
+			if (_access(s, *found)) {
+				_count(counter::hits);
+				return {found->my_ref, false};
+			}
+			_unlink(s, *found);
+			_count(counter::expirations);
+		} else if (_snapshot) {
+			if (cached_resource<Value> stored = _materialize(s, key, hashed)) {
+				_count(counter::hits);
+				return {std::move(stored), false};
+			}
+		}
+		_count(counter::misses);
+
+		return {_emplace(s, expires, std::forward<T>(key), hashed, std::forward<Args>(args)...), true};
+	}
+
+	template <typename T, typename... Args>
+	cached_resource<Value> _emplace(shard& s, expiry const& expires, T&& key, size_t hash, Args&&... args) noexcept(nothrow_emplace<T, Args...>) {
+		// Allocate everything first, so that a failure leaves no half-inserted node behind
+		if (_epoch && (s.free_nodes.empty() || s.retired.size() >= retire_batch)) {
+			_collect(s);
+		}
+		s.index.reserve(s.index.size() + 1);
+		if (s.free_nodes.empty()) {
+			bucket& b = *s.buckets.emplace_back(std::make_unique<bucket>());
+
+			// Room for every node, so that evictions can give them back without allocating
+			s.free_nodes.reserve(s.buckets.size() * bucket::num_elements);
+			if (_epoch) {
+				s.retired.reserve(s.buckets.size() * bucket::num_elements);
+			}
+			for (node& n : b.data | std::views::reverse) {
+				n.elem.second.set_per_thread_references(_per_thread_references);
+				s.free_nodes.push_back(&n);
+			}
+		}
+
+		node* n = s.free_nodes.back();
+		n->hash = hash;
+		n->elem.first = std::forward<T>(key);
+		n->my_ref = n->elem.second.emplace(std::forward<Args>(args)...);
+		n->deadline.store(expires.deadline, std::memory_order_relaxed);
+		n->time_to_live = expires.time_to_live;
+		n->linked = true;
+		s.free_nodes.pop_back();
+		s.index.insert(hash, n);
+		_count(counter::inserts);
+
+		// Hold our own reference before evicting, so that the new entry can't be picked
+		cached_resource<Value> ret = n->my_ref;
+		if (_shard_capacity > 0) {
+			n->weight = _weigher ? _weigher(n->elem.first, n->elem.second.get()) : 1;
+			s.weight += n->weight;
+			s.eviction.insert(*n, s.index.size());
+			_evict_over_capacity(s);
+		}
+		return ret;
+	}
+
+	template <typename T>
+	load_ticket _join_load(shard& s, T&& key, size_t hash) {
+		if (cached_resource<Value> found = _find_ref(s, key, hash)) {
+			_count(counter::hits);
+			return {std::move(found), nullptr};
+		}
+
+		auto lock = _lock<std::unique_lock>(s);
+
+		// Someone may have inserted or started loading the key while we were not holding the lock
+		if (node* found = _find_node(s, key, hash); found != nullptr) {
+			if (_access(s, *found)) {
+				_count(counter::hits);
+				return {found->my_ref, nullptr};
+			}
+		} else if (_snapshot) {
+			if (cached_resource<Value> stored = _materialize(s, key, hash)) {
+				_count(counter::hits);
+				return {std::move(stored), nullptr};
+			}
+		}
+		_count(counter::misses);
+		for (std::shared_ptr<pending_load>& load : s.loads) {
+			if (load->hash == hash && Equal{}(load->key, key)) {
+				return {{}, load, false};
+			}
+		}
+		s.loads.reserve(s.loads.size() + 1);
+		return {{}, s.loads.emplace_back(std::make_shared<pending_load>(hash, Key(std::forward<T>(key)))), true};
+	}
+
+	/**
+	 * @brief Inserts the result of `load`, unless the key was inserted by other means in the meantime.
+	 */
+	template <typename U>
+	cached_resource<Value> _finish_load(shard& s, pending_load& load, U&& value) {
+		auto lock = _lock<std::unique_lock>(s);
+
+		std::erase_if(s.loads, [&load](std::shared_ptr<pending_load> const& l) noexcept { return l.get() == &load; });
+		if (node* found = _find_node(s, load.key, load.hash); found != nullptr) {
+			if (_access(s, *found)) {
+				return found->my_ref;
+			}
+			_unlink(s, *found);
+			_count(counter::expirations);
+		}
+		return _emplace(s, _default_expiry(), Key(load.key), load.hash, std::forward<U>(value));
+	}
+
+	void _abandon_load(shard& s, pending_load& load) noexcept {
+		auto lock = _lock<std::unique_lock>(s);
+
+		_count(counter::load_failures);
+		std::erase_if(s.loads, [&load](std::shared_ptr<pending_load> const& l) noexcept { return l.get() == &load; });
+	}
+
+	void _evict_over_capacity(shard& s) noexcept {
+		auto evictable = [](node& n) noexcept {
+			return _unused(n);
+		};
+
+		while (s.weight > _shard_capacity) {
+			node* victim = s.eviction.victim(evictable);
+
+			if (victim == nullptr) {
+				return;
+			}
+			_unlink(s, *victim);
+			_count(counter::evictions);
+		}
+	}
+
+	/**
+	 * @brief Removes `n` from the index, and frees it unless someone still holds its value or lock-free lookups may still see it.
+	 */
+	void _unlink(shard& s, node& n) noexcept {
+		s.index.erase(n.hash, &n);
+		if (_shard_capacity > 0) {
+			s.eviction.erase(n);
+			s.weight -= n.weight;
+		}
+		n.linked = false;
+		if (_epoch) {
+			n.retired = true;
+			s.retired.push_back(&n);
+		} else if (_unused(n)) {
+			_reclaim(s, n);
+		}
+	}
+
+	/**
+	 * @brief With lock-free reads, waits for lookups to let go of retired nodes and replaced index tables, then frees them.
+	 *
+	 * Nodes which someone acquired before they were retired stay allocated until `sweep` finds them unused.
+	 */
+	void _collect(shard& s) noexcept {
+		if (s.retired.empty() && !s.index.has_retired()) {
+			return;
+		}
+		_epoch->synchronize();
+		for (node* n : s.retired) {
+			n->retired = false;
+			if (_unused(*n)) {
+				_reclaim(s, *n);
+			}
+		}
+		s.retired.clear();
+		s.index.reclaim();
+	}
+
+	/**
+	 * @brief Returns whether the cache's own reference to the value of `n` is the last one, so that nobody can be using it.
+	 *
+	 * With per-thread references, threads keep idle references to values they used recently, see `detail::cache_reference_table`;
+	 * those are given back first.
+	 */
+	static bool _unused(node& n) noexcept {
+		if (n.elem.second.use_count() != 1 && n.elem.second.per_thread_references()) {
+			detail::cache_reference_table::revoke(&n.elem.second);
+		}
+		return n.elem.second.use_count() == 1;
+	}
+
+	bool _owns(void const* address) const noexcept {
+		auto a = reinterpret_cast<uintptr_t>(address);
+
+		for (shard const& s : std::span{_shards.get(), _num_shards}) {
+			for (auto const& b : s.buckets) {
+				auto begin = reinterpret_cast<uintptr_t>(b->data.data());
+
+				if (a >= begin && a < begin + sizeof(b->data)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
 
-		bucket &b = _buckets.emplace_back();
-		b.data[0].hash = hash;
-		b.data[0].elem.first = std::forward<T>(key);
-		b.data[0].my_ref = b.data[0].elem.second.emplace(std::forward<Args>(args)...);
-		return {b.data[0].my_ref};
+	void _reclaim(shard& s, node& n) noexcept {
+		n.my_ref.release();
+		n.elem.first = Key{};
+		s.free_nodes.push_back(&n);
 	}
 
-	mutable std::shared_mutex mutex;
-	std::list<bucket> _buckets;
+	size_t                                  _num_shards;
+	unsigned                                _shard_shift;
+	size_t                                  _shard_capacity;
+	clock::duration                         _time_to_live;
+	bool                                    _expire_after_access;
+	bool                                    _per_thread_references;
+	weigher_t                               _weigher;
+	std::unique_ptr<shard[]>                _shards;
+	std::atomic<size_t>                     _sweep_shard{0};
+	std::unique_ptr<detail::cache_counters> _counters; // Null unless statistics are recorded
+	std::unique_ptr<detail::cache_epoch>    _epoch; // Null unless reads are lock-free
+	std::unique_ptr<detail::cache_snapshot> _snapshot; // Null unless warming up from a snapshot
 };
 
 }
 
-#endif SHION_CACHE_H_
+#endif /* SHION_CACHE_H_ */
@@ -0,0 +1,66 @@
+module;
+
+#include <shion/export.hpp>
+#include <shion/common/defines.hpp>
+
+#if !SHION_IMPORT_STD
+#include <atomic>
+#include <type_traits>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <cassert>
+#include <optional>
+#include <ranges>
+#include <utility>
+#include <vector>
+#include <format>
+#include <source_location>
+#endif
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+export module shion:cache;
+
+#if SHION_IMPORT_STD
+import std;
+#endif
+import :common;
+import :utility;
+import :meta;
+import :coro;
+import :io;
+
+using namespace SHION_NAMESPACE ::literals;
+
+#if SHION_EXTERN_MODULES
+extern "C++" {
+#endif
+
+#include "shion/cache.hpp"
+
+#if SHION_EXTERN_MODULES
+}
+#endif
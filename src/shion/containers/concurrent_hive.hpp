@@ -0,0 +1,335 @@
+#ifndef SHION_CONTAINERS_CONCURRENT_HIVE_H_
+#define SHION_CONTAINERS_CONCURRENT_HIVE_H_
+
+#include <shion/common/defines.hpp>
+
+#if !SHION_BUILDING_MODULES
+#include <type_traits>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <shion/common.hpp>
+#include <shion/containers/hive.hpp>
+#endif
+
+namespace SHION_NAMESPACE {
+
+namespace detail {
+
+template <typename T, ssize_t TargetSize>
+inline constexpr ssize_t concurrent_hive_page_num_skipfields = hive_page_num_groups(
+	TargetSize,
+	2 * sizeof(std::atomic<ssize_t>),
+	2 * sizeof(std::atomic<uint64>) + 64 * sizeof(T),
+	alignof(T)
+);
+
+template <typename T, ssize_t NumSkipfields>
+struct concurrent_hive_page {
+	static inline constexpr ssize_t num_elements = NumSkipfields * 64;
+
+	concurrent_hive_page() = default;
+	concurrent_hive_page(concurrent_hive_page const&) = delete;
+	concurrent_hive_page& operator=(concurrent_hive_page const&) = delete;
+
+	~concurrent_hive_page() {
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			for (ssize_t i = 0; i < NumSkipfields; ++i) {
+				for (auto live = _live[i].load(std::memory_order_relaxed); live != 0; live &= live - 1) {
+					data[(i << 6) | std::countr_zero(live)].destroy();
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Claims a free slot, or returns -1 if the page is full.
+	 *
+	 * The slot is reserved but holds no element yet: it is only visible to readers once `publish` is called.
+	 */
+	ssize_t claim() noexcept {
+		// Reserve first: once we hold one of the `num_elements` reservations, some bit is guaranteed to be free for us
+		if (_claimed_count.fetch_add(1, std::memory_order_relaxed) >= num_elements) {
+			_claimed_count.fetch_sub(1, std::memory_order_relaxed);
+			return -1;
+		}
+		for (auto i = _first_free_skipfield.load(std::memory_order_relaxed);; i = (i + 1 < NumSkipfields ? i + 1 : 0)) {
+			auto word = _claimed[i].load(std::memory_order_relaxed);
+
+			while (word != ~0_u64) {
+				auto bit = 1_u64 << std::countr_one(word);
+
+				// Acquire pairs with the release in `release`, so the previous element is fully destroyed
+				word = _claimed[i].fetch_or(bit, std::memory_order_acq_rel);
+				if ((word & bit) == 0) {
+					_first_free_skipfield.store(i, std::memory_order_relaxed);
+					return (i << 6) | std::countr_zero(bit);
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Makes a constructed element in a claimed slot visible to readers.
+	 */
+	void publish(ssize_t index) noexcept {
+		_live[index >> 6].fetch_or(1_u64 << (index & 63), std::memory_order_release);
+	}
+
+	/**
+	 * @brief Gives back a claimed slot that holds no element.
+	 */
+	void release(ssize_t index) noexcept {
+		_claimed[index >> 6].fetch_and(~(1_u64 << (index & 63)), std::memory_order_release);
+		_claimed_count.fetch_sub(1, std::memory_order_relaxed);
+		if (auto hint = _first_free_skipfield.load(std::memory_order_relaxed); (index >> 6) < hint) {
+			_first_free_skipfield.compare_exchange_strong(hint, index >> 6, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @brief Destroys the element at `index`. Returns false if there was none, e.g. another thread erased it first.
+	 */
+	bool erase(ssize_t index) noexcept(std::is_nothrow_destructible_v<T>) {
+		auto bit = 1_u64 << (index & 63);
+
+		// Only one thread can see the bit go from set to clear, that thread owns the element
+		if ((_live[index >> 6].fetch_and(~bit, std::memory_order_acq_rel) & bit) == 0) {
+			return false;
+		}
+		data[index].destroy();
+		release(index);
+		return true;
+	}
+
+	void clear() noexcept(std::is_nothrow_destructible_v<T>) {
+		for (ssize_t i = 0; i < NumSkipfields; ++i) {
+			for (auto live = _live[i].load(std::memory_order_relaxed); live != 0; live &= live - 1) {
+				erase((i << 6) | std::countr_zero(live));
+			}
+		}
+	}
+
+	bool has(ssize_t index) const noexcept {
+		return (_live[index >> 6].load(std::memory_order_acquire) & (1_u64 << (index & 63))) != 0;
+	}
+
+	bool full() const noexcept {
+		return _claimed_count.load(std::memory_order_relaxed) >= num_elements;
+	}
+
+	template <typename Fn>
+	void for_each(Fn& fn) {
+		for (ssize_t i = 0; i < NumSkipfields; ++i) {
+			for (auto live = _live[i].load(std::memory_order_acquire); live != 0; live &= live - 1) {
+				std::invoke(fn, data[(i << 6) | std::countr_zero(live)].value);
+			}
+		}
+	}
+
+	std::atomic<uint64>                       _claimed[NumSkipfields]{};
+	std::atomic<uint64>                       _live[NumSkipfields]{};
+	std::atomic<ssize_t>                      _claimed_count{0};
+	std::atomic<ssize_t>                      _first_free_skipfield{0};
+	std::array<hive_storage<T>, num_elements> data{};
+};
+
+}
+
+/**
+ * @brief Variant of `hive` that can be filled and emptied from several threads at once.
+ *
+ * Slots are claimed with an atomic fetch-or on per-page bitmaps, so concurrent `emplace` calls only contend
+ * when they hit the same word. New pages are appended under a mutex, which is only taken once every page is full.
+ * Pages are never freed before the hive is destroyed, so raw indices and element addresses stay valid for its lifetime.
+ *
+ * `emplace`, `erase`, `get`, `for_each` and `size` may be called concurrently with each other.
+ * Readers only ever see fully constructed elements, but nothing stops another thread from erasing an element
+ * while it is being read: synchronizing readers with erasers of the same elements is up to the caller.
+ * `clear` and destruction must not run concurrently with anything else.
+ *
+ * @tparam PageSize Page size policy, see `hive_page_size`.
+ */
+SHION_EXPORT template <typename T, typename PageSize = hive_default_page_size>
+class concurrent_hive {
+	using page_t = detail::concurrent_hive_page<T, detail::concurrent_hive_page_num_skipfields<T, PageSize::target_size>>;
+
+	static_assert(lossless_cast<ssize_t>(sizeof(page_t)) <= PageSize::target_size || detail::concurrent_hive_page_num_skipfields<T, PageSize::target_size> == 1, "page overhead was not budgeted for");
+
+public:
+	static inline constexpr auto elements_per_page = page_t::num_elements;
+
+	concurrent_hive() = default;
+	concurrent_hive(concurrent_hive const&) = delete;
+	concurrent_hive& operator=(concurrent_hive const&) = delete;
+	~concurrent_hive() = default;
+
+	/**
+	 * @brief Constructs an element in a free slot and returns its raw index.
+	 */
+	template <typename... Args>
+	requires (std::constructible_from<T, Args...>)
+	ssize_t emplace(Args&&... args) {
+		for (;;) {
+			auto page_count = _page_count.load(std::memory_order_acquire);
+			auto pages = _directory.load(std::memory_order_acquire);
+
+			for (auto page_idx = _first_free_page.load(std::memory_order_relaxed); page_idx < page_count; ++page_idx) {
+				page_t* page = pages[page_idx];
+
+				if (page->full()) {
+					// Every page before `_first_free_page` is known to be full, move it past this one if nobody else did
+					auto expected = page_idx;
+					_first_free_page.compare_exchange_weak(expected, page_idx + 1, std::memory_order_relaxed);
+					continue;
+				}
+				if (auto idx = page->claim(); idx >= 0) {
+					_construct(page, idx, std::forward<Args>(args)...);
+					return page_idx * elements_per_page + idx;
+				}
+			}
+			_add_page(page_count);
+		}
+	}
+
+	/**
+	 * @brief Destroys the element at raw index `index`. Returns false if there was none.
+	 */
+	bool erase(ssize_t index) noexcept(std::is_nothrow_destructible_v<T>) {
+		page_t* page = _get_page(index);
+
+		if (page == nullptr || !page->erase(index % elements_per_page)) {
+			return false;
+		}
+		_size.fetch_sub(1, std::memory_order_relaxed);
+		auto page_idx = index / elements_per_page;
+		if (auto hint = _first_free_page.load(std::memory_order_relaxed); page_idx < hint) {
+			_first_free_page.compare_exchange_strong(hint, page_idx, std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Returns the element at raw index `index`, or nullptr if there is none.
+	 */
+	T* get(ssize_t index) noexcept {
+		page_t* page = _get_page(index);
+
+		if (page == nullptr || !page->has(index % elements_per_page)) {
+			return nullptr;
+		}
+		return std::addressof(page->data[index % elements_per_page].value);
+	}
+
+	T const* get(ssize_t index) const noexcept {
+		return const_cast<concurrent_hive*>(this)->get(index);
+	}
+
+	/**
+	 * @brief Invokes `fn` on every element published before the call reaches its page.
+	 */
+	template <typename Fn>
+	requires (std::invocable<Fn&, T&>)
+	void for_each(Fn fn) {
+		auto page_count = _page_count.load(std::memory_order_acquire);
+		auto pages = _directory.load(std::memory_order_acquire);
+
+		for (ssize_t i = 0; i < page_count; ++i) {
+			pages[i]->for_each(fn);
+		}
+	}
+
+	/**
+	 * @brief Destroys every element. Not thread-safe.
+	 */
+	void clear() noexcept(std::is_nothrow_destructible_v<T>) {
+		auto page_count = _page_count.load(std::memory_order_relaxed);
+		auto pages = _directory.load(std::memory_order_relaxed);
+
+		for (ssize_t i = 0; i < page_count; ++i) {
+			pages[i]->clear();
+		}
+		_size.store(0, std::memory_order_relaxed);
+		_first_free_page.store(0, std::memory_order_relaxed);
+	}
+
+	ssize_t size() const noexcept {
+		return _size.load(std::memory_order_relaxed);
+	}
+
+	ssize_t capacity() const noexcept {
+		return pages() * elements_per_page;
+	}
+
+	ssize_t pages() const noexcept {
+		return _page_count.load(std::memory_order_relaxed);
+	}
+
+private:
+	template <typename... Args>
+	void _construct(page_t* page, ssize_t idx, Args&&... args) {
+		if constexpr (std::is_nothrow_constructible_v<T, Args...>) {
+			page->data[idx].emplace(std::forward<Args>(args)...);
+		} else {
+			try {
+				page->data[idx].emplace(std::forward<Args>(args)...);
+			} catch (...) {
+				page->release(idx);
+				throw;
+			}
+		}
+		page->publish(idx);
+		_size.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	page_t* _get_page(ssize_t index) const noexcept {
+		if (index < 0) {
+			return nullptr;
+		}
+		auto page_idx = index / elements_per_page;
+		if (page_idx >= _page_count.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return _directory.load(std::memory_order_acquire)[page_idx];
+	}
+
+	/**
+	 * @brief Appends a page, unless another thread already did since we saw `seen_page_count` pages.
+	 */
+	void _add_page(ssize_t seen_page_count) {
+		std::lock_guard lock{_grow_mutex};
+
+		if (_page_count.load(std::memory_order_relaxed) != seen_page_count) {
+			return;
+		}
+		if (seen_page_count == std::ssize(_directories.back())) {
+			// Readers may still be using the old directory, keep it alive until we are destroyed
+			std::vector<page_t*> grown(std::max<size_t>(seen_page_count * 2, 8));
+
+			std::ranges::copy(_directories.back(), grown.begin());
+			_directories.push_back(std::move(grown));
+			_directory.store(_directories.back().data(), std::memory_order_release);
+		}
+		_pages.push_back(std::make_unique<page_t>());
+		_directories.back()[seen_page_count] = _pages.back().get();
+		_page_count.store(seen_page_count + 1, std::memory_order_release);
+	}
+
+	std::atomic<ssize_t>                 _size{0};
+	std::atomic<ssize_t>                 _page_count{0};
+	std::atomic<ssize_t>                 _first_free_page{0};
+	std::mutex                           _grow_mutex;
+	std::vector<std::unique_ptr<page_t>> _pages{};
+	std::vector<std::vector<page_t*>>    _directories{1};
+	std::atomic<page_t**>                _directory{nullptr};
+};
+
+}
+
+#endif /* SHION_CONTAINERS_CONCURRENT_HIVE_H_ */
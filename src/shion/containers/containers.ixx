@@ -19,10 +19,17 @@ module;
 #include <fstream>
 #include <functional>
 #include <list>
+#include <vector>
+#include <bit>
+#include <cstring>
 #include <format>
 #include <unordered_set>
 #include <unordered_map>
 #include <source_location>
+#include <atomic>
+#include <mutex>
+#include <latch>
+#include <thread>
 #endif
 
 export module shion:containers;
@@ -41,6 +48,8 @@ extern "C++" {
 #endif
 	
 #include "shion/containers/hive.hpp"
+#include "shion/containers/concurrent_hive.hpp"
+#include "shion/containers/soa_hive.hpp"
 
 #if SHION_EXTERN_MODULES
 }
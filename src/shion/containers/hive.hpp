@@ -5,29 +5,101 @@
 
 #if !SHION_BUILDING_MODULES
 #include <type_traits>
+#include <algorithm>
+#include <atomic>
 #include <bit>
-#include <list>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <shion/common.hpp>
 #include <shion/common/detail.hpp>
+#include <shion/common/tools.hpp>
 #include <shion/meta/type_traits.hpp>
 #include <shion/utility/optional.hpp>
 #endif
 
 namespace SHION_NAMESPACE {
 
-SHION_EXPORT template <typename T>
+/**
+ * @brief Page size policy for `hive`.
+ *
+ * Each page holds as many elements as fit in `TargetSize` bytes along with the page's bookkeeping,
+ * rounded down to a multiple of 64 with a minimum of 64. A page is only larger than `TargetSize` when a single
+ * group of 64 elements does not fit in it.
+ * Larger pages suit tiny elements (e.g. 2 MiB pages to be backed by huge pages), smaller ones suit large elements.
+ */
+SHION_EXPORT template <ssize_t TargetSize>
+struct hive_page_size {
+	static_assert(TargetSize > 0, "page size must be positive");
+
+	static inline constexpr ssize_t target_size = TargetSize;
+};
+
+SHION_EXPORT using hive_default_page_size = hive_page_size<24 * 1024>;
+
+SHION_EXPORT template <typename T, typename PageSize = hive_default_page_size, typename Allocator = std::allocator<T>, bool Handles = false>
 class hive;
 
+/**
+ * @brief `hive` with generational handles, see `hive::handle`. Each slot then also stores a 32-bit generation.
+ */
+SHION_EXPORT template <typename T, typename PageSize = hive_default_page_size, typename Allocator = std::allocator<T>>
+using handle_hive = hive<T, PageSize, Allocator, true>;
+
 namespace detail {
 
-inline constexpr ssize_t hive_page_target_size = 24 * 1024;
+namespace serializer {
 
-template <typename T>
-inline constexpr ssize_t hive_page_num_skipfields = std::max(1_sst, lossless_cast<ssize_t>((hive_page_target_size / sizeof(T)) / 64));
+template <typename Hive, typename Tag>
+struct hive_serializer;
 
-template <typename T>
-inline constexpr ssize_t hive_page_num_elements = hive_page_num_skipfields<T> * 64;
+}
+
+/**
+ * @brief Number of groups of 64 slots that fit in a page of `target_size` bytes, with a minimum of 1.
+ *
+ * @param header Bytes taken by the page regardless of its number of slots.
+ * @param group Bytes taken by each group of 64 slots: elements, skipfield and any other per-slot bookkeeping.
+ * @param align Alignment of the elements, padding before them is budgeted for when it exceeds that of the bookkeeping.
+ */
+inline constexpr ssize_t hive_page_num_groups(ssize_t target_size, ssize_t header, ssize_t group, ssize_t align) noexcept {
+	auto padding = align > lossless_cast<ssize_t>(alignof(uint64)) ? align : 0;
+
+	return std::max(1_sst, (target_size - header - padding) / group);
+}
+
+template <typename T, ssize_t TargetSize, bool Generations>
+inline constexpr ssize_t hive_page_num_skipfields = hive_page_num_groups(
+	TargetSize,
+	3 * sizeof(ssize_t),
+	sizeof(uint64) + 64 * (sizeof(T) + (Generations ? sizeof(uint32) : 0)),
+	alignof(T)
+);
+
+template <typename T, ssize_t TargetSize, bool Generations>
+inline constexpr ssize_t hive_page_num_elements = hive_page_num_skipfields<T, TargetSize, Generations> * 64;
+
+/**
+ * @brief Generation of each slot of a page, only present in hives with handles.
+ */
+template <ssize_t NumElements, bool Enabled>
+struct hive_page_generations {
+	uint32 _generations[NumElements]{};
+};
+
+template <ssize_t NumElements>
+struct hive_page_generations<NumElements, false> {
+};
 
 template <typename T>
 union hive_storage {
@@ -65,179 +137,207 @@ union hive_storage<T> {
 	T value;
 };
 
-template <typename T>
+template <typename T, ssize_t NumSkipfields, bool Generations>
 class hive_page_base;
 
-template <typename T>
+template <typename T, ssize_t NumSkipfields, bool Generations>
 requires (std::is_trivial_v<T>)
-class hive_page_base<T> {
+class hive_page_base<T, NumSkipfields, Generations> : protected hive_page_generations<NumSkipfields * 64, Generations> {
 protected:
-	friend class hive<T>;
-
-	ssize_t                                                   global_index_of_first{};
-	uint64                                                    _skipfields[hive_page_num_elements<T>];
-	std::array<hive_storage<T>, hive_page_num_elements<T>> data{};
+	template <typename, typename, typename, bool>
+	friend class SHION_NAMESPACE::hive;
+	template <typename, typename>
+	friend struct serializer::hive_serializer;
+
+	ssize_t                                         global_index_of_first{};
+	ssize_t                                         _size{};
+	ssize_t                                         _first_free_skipfield{};
+	uint64                                          _skipfields[NumSkipfields]{};
+	std::array<hive_storage<T>, NumSkipfields * 64> data{};
 };
 
-template <typename T>
-class hive_page_base {
+template <typename T, ssize_t NumSkipfields, bool Generations>
+class hive_page_base : protected hive_page_generations<NumSkipfields * 64, Generations> {
+	using generations_t = hive_page_generations<NumSkipfields * 64, Generations>;
+
 public:
 	constexpr hive_page_base() noexcept = default;
 
-	constexpr hive_page_base(const hive_page_base& rhs) noexcept(std::is_nothrow_copy_constructible_v<T>) requires (std::is_copy_constructible_v<T>) {
-		for (size_t i = 0; i < hive_page_num_skipfields<T>; ++i) {
-			auto rhs_field = rhs._skipfields[i];
+	constexpr hive_page_base(const hive_page_base& rhs) noexcept(std::is_nothrow_copy_constructible_v<T>) requires (std::is_copy_constructible_v<T>) :
+		generations_t(rhs),
+		global_index_of_first{rhs.global_index_of_first},
+		_size{rhs._size},
+		_first_free_skipfield{rhs._first_free_skipfield} {
+		if constexpr (std::is_trivially_copyable_v<T>) {
+			_copy_block(rhs);
+		} else {
+			_construct_from(rhs, [](hive_storage<T>& slot, hive_storage<T> const& rhs_slot) { slot.emplace(rhs_slot.value); });
+		}
+	}
+	constexpr hive_page_base(hive_page_base&& rhs) noexcept(std::is_nothrow_move_constructible_v<T>) requires (std::is_move_constructible_v<T>) :
+		generations_t(rhs),
+		global_index_of_first{rhs.global_index_of_first},
+		_size{rhs._size},
+		_first_free_skipfield{rhs._first_free_skipfield} {
+		if constexpr (std::is_trivially_copyable_v<T>) {
+			_copy_block(rhs);
+		} else {
+			_construct_from(rhs, [](hive_storage<T>& slot, hive_storage<T>& rhs_slot) { slot.emplace(std::move(rhs_slot.value)); });
+		}
+	}
+	constexpr ~hive_page_base() noexcept requires (std::is_trivially_destructible_v<T>) = default;
+	constexpr ~hive_page_base() noexcept(std::is_nothrow_destructible_v<T>) requires (!std::is_trivially_destructible_v<T>) {
+		_destroy_all();
+	}
 
-			if (rhs_field == 0) {
-				continue;
-			}
-			for (size_t j = 0; j < 64; ++j) {
-				size_t flag = (1_st << j);
-				size_t idx = (i << 6) | j;
-				if ((rhs_field & flag) != 0) {
-					data[idx].emplace(rhs.data[idx].value);
-					if constexpr (!std::is_nothrow_copy_constructible_v<T>) {
-						_skipfields[i] |= flag;
-					}
-				}
-				if constexpr (std::is_nothrow_copy_constructible_v<T>) {
-					_skipfields[i] = rhs_field;
-				}
+	constexpr hive_page_base& operator=(const hive_page_base& rhs) noexcept(is_nothrow_copyable<T> && std::is_nothrow_destructible_v<T>) requires (is_copyable<T>) {
+		if (this != &rhs) {
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				_copy_block(rhs);
+			} else {
+				_assign_from(
+					rhs,
+					[](hive_storage<T>& slot, hive_storage<T> const& rhs_slot) { slot.value = rhs_slot.value; },
+					[](hive_storage<T>& slot, hive_storage<T> const& rhs_slot) { slot.emplace(rhs_slot.value); }
+				);
 			}
+			_copy_metadata(rhs);
 		}
+		return *this;
 	}
-	constexpr hive_page_base(hive_page_base&& rhs) noexcept(std::is_nothrow_move_constructible_v<T>) requires (std::is_move_constructible_v<T>) {
-		for (size_t i = 0; i < hive_page_num_skipfields<T>; ++i) {
-			auto rhs_field = rhs._skipfields[i];
 
-			if (rhs_field == 0) {
-				continue;
-			}
-			for (size_t j = 0; j < 64; ++j) {
-				size_t flag = (1_st << j);
-				size_t idx = (i << 6) | j;
-				if ((rhs_field & flag) != 0) {
-					data[idx].emplace(rhs.data[idx].value);
-					if constexpr (!std::is_nothrow_move_constructible_v<T>) {
-						_skipfields[i] |= flag;
-					}
-				}
-				if constexpr (std::is_nothrow_move_constructible_v<T>) {
-					_skipfields[i] = rhs_field;
-				}
+	constexpr hive_page_base& operator=(hive_page_base&& rhs) noexcept(is_nothrow_moveable<T> && std::is_nothrow_destructible_v<T>) requires (is_moveable<T>) {
+		if (this != &rhs) {
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				_copy_block(rhs);
+			} else {
+				_assign_from(
+					rhs,
+					[](hive_storage<T>& slot, hive_storage<T>& rhs_slot) { slot.value = std::move(rhs_slot.value); },
+					[](hive_storage<T>& slot, hive_storage<T>& rhs_slot) { slot.emplace(std::move(rhs_slot.value)); }
+				);
 			}
+			_copy_metadata(rhs);
 		}
+		return *this;
 	}
-	constexpr ~hive_page_base() noexcept requires (std::is_trivially_destructible_v<T>) = default;
-	constexpr ~hive_page_base() noexcept(std::is_nothrow_destructible_v<T>) requires (!std::is_trivially_destructible_v<T>) {
-		for (ssize_t i = 0; i < hive_page_num_skipfields<T>; ++i) {
-			if (_skipfields[i] == 0) {
-				continue;
-			} else if (_skipfields[i] == ~0_u64) {
-				for (ssize_t j = 0; j < 64; ++j) {
-					data[(i << 6) | j].destroy();
-				}
-			} else {
-				for (ssize_t j = 0; j < 64; ++j) {
-					if ((_skipfields[i] & (1_u64 << j)) != 0) {
-						data[(i << 6) | j].destroy();
-					}
+
+private:
+	/**
+	 * @brief Copies the skipfields and the whole element array in one block. Only valid for trivially copyable `T`.
+	 */
+	constexpr void _copy_block(hive_page_base const& rhs) noexcept {
+		std::ranges::copy(rhs._skipfields, _skipfields);
+		std::memcpy(static_cast<void*>(data.data()), rhs.data.data(), sizeof(data));
+	}
+
+	constexpr void _copy_metadata(hive_page_base const& rhs) noexcept {
+		global_index_of_first = rhs.global_index_of_first;
+		_size = rhs._size;
+		_first_free_skipfield = rhs._first_free_skipfield;
+		static_cast<generations_t&>(*this) = rhs;
+	}
+
+	/**
+	 * @brief Constructs an element from each live element of `rhs`. If a constructor throws, everything constructed so far is destroyed.
+	 */
+	template <typename Rhs, typename Construct>
+	constexpr void _construct_from(Rhs& rhs, Construct construct) {
+		try {
+			for (ssize_t i = 0; i < NumSkipfields; ++i) {
+				for (auto live = rhs._skipfields[i]; live != 0; live &= live - 1) {
+					auto j = std::countr_zero(live);
+					construct(data[(i << 6) | j], rhs.data[(i << 6) | j]);
+					_skipfields[i] |= (1_u64 << j);
 				}
 			}
+		} catch (...) {
+			_destroy_all();
+			throw;
 		}
 	}
 
-	constexpr hive_page_base& operator=(const hive_page_base& rhs) noexcept(is_nothrow_copyable<T> && std::is_nothrow_destructible_v<T>) requires (is_copyable<T>) {
-		constexpr auto nothrow = is_nothrow_copyable<T> && std::is_nothrow_destructible_v<T>;
-
-		for (size_t i = 0; i < hive_page_num_skipfields<T>; ++i) {
-			auto rhs_field = rhs._skipfields[i];
-			auto &lhs_field = _skipfields[i];
-
-			for (size_t j = 0; j < 64; ++j) {
-				size_t flag = (1_st << j);
-				size_t idx = (i << 6) | j;
-				if ((lhs_field & flag) != 0) {
-					if ((rhs_field & flag) != 0) {
-						data[idx].value = rhs.data[idx].value;
-					} else {
-						data[idx].destroy();
-						if constexpr (!nothrow) {
-							lhs_field &= ~flag;
-						}
-					}
-				} else {
-					if ((rhs_field & flag) != 0) {
-						data[idx].emplace(rhs.data[idx].value);
-						if constexpr (!nothrow) {
-							lhs_field |= flag;
-						}
-					}
+	/**
+	 * @brief Makes the live elements match `rhs`: assigns where both pages have an element, destroys or constructs elsewhere.
+	 *
+	 * Skipfields are kept accurate after every element, so the page stays consistent if an operation throws.
+	 */
+	template <typename Rhs, typename Assign, typename Construct>
+	constexpr void _assign_from(Rhs& rhs, Assign assign, Construct construct) {
+		try {
+			for (ssize_t i = 0; i < NumSkipfields; ++i) {
+				auto rhs_field = rhs._skipfields[i];
+				auto lhs_field = _skipfields[i];
+
+				for (auto bits = lhs_field & ~rhs_field; bits != 0; bits &= bits - 1) {
+					auto j = std::countr_zero(bits);
+					data[(i << 6) | j].destroy();
+					_skipfields[i] &= ~(1_u64 << j);
+				}
+				for (auto bits = lhs_field & rhs_field; bits != 0; bits &= bits - 1) {
+					auto j = std::countr_zero(bits);
+					assign(data[(i << 6) | j], rhs.data[(i << 6) | j]);
 				}
-				if constexpr (nothrow) {
-					_skipfields[i] = rhs_field;
+				for (auto bits = rhs_field & ~lhs_field; bits != 0; bits &= bits - 1) {
+					auto j = std::countr_zero(bits);
+					construct(data[(i << 6) | j], rhs.data[(i << 6) | j]);
+					_skipfields[i] |= (1_u64 << j);
 				}
 			}
+		} catch (...) {
+			_size = 0;
+			for (auto field : _skipfields) {
+				_size += std::popcount(field);
+			}
+			_first_free_skipfield = 0;
+			throw;
 		}
-		return *this;
 	}
 
-	constexpr hive_page_base& operator=(hive_page_base&& rhs) noexcept(is_nothrow_moveable<T>) requires (is_moveable<T>) {
-		constexpr auto nothrow = is_nothrow_copyable<T> && std::is_nothrow_destructible_v<T>;
-
-		for (size_t i = 0; i < hive_page_num_skipfields<T>; ++i) {
-			auto rhs_field = rhs._skipfields[i];
-			auto &lhs_field = _skipfields[i];
-
-			for (size_t j = 0; j < 64; ++j) {
-				size_t flag = (1_st << j);
-				size_t idx = (i << 6) | j;
-				if ((lhs_field & flag) != 0) {
-					if ((rhs_field & flag) != 0) {
-						data[idx].value = std::move(rhs.data[idx].value);
-					} else {
-						data[idx].destroy();
-						if constexpr (!nothrow) {
-							lhs_field &= ~flag;
-						}
-					}
-				} else {
-					if ((rhs_field & flag) != 0) {
-						data[idx].emplace(std::move(rhs.data[idx].value));
-						if constexpr (!nothrow) {
-							lhs_field |= flag;
-						}
-					}
-				}
-				if constexpr (nothrow) {
-					_skipfields[i] = rhs_field;
+	constexpr void _destroy_all() noexcept(std::is_nothrow_destructible_v<T>) {
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			for (ssize_t i = 0; i < NumSkipfields; ++i) {
+				for (auto live = _skipfields[i]; live != 0; live &= live - 1) {
+					data[(i << 6) | std::countr_zero(live)].destroy();
 				}
+				_skipfields[i] = 0;
 			}
 		}
-		return *this;
 	}
 
 protected:
-	friend class hive<T>;
-
-	ssize_t                                                 global_index_of_first{};
-	uint64                                                  _skipfields[hive_page_num_skipfields<T>]{};
-	std::array<hive_storage<T>, hive_page_num_elements<T>> data{};
+	template <typename, typename, typename, bool>
+	friend class SHION_NAMESPACE::hive;
+	template <typename, typename>
+	friend struct serializer::hive_serializer;
+
+	ssize_t                                         global_index_of_first{};
+	ssize_t                                         _size{};
+	ssize_t                                         _first_free_skipfield{};
+	uint64                                          _skipfields[NumSkipfields]{};
+	std::array<hive_storage<T>, NumSkipfields * 64> data{};
 };
 
-template <typename T>
-class hive_page : public hive_page_base<T> {
+template <typename T, ssize_t NumSkipfields, bool Generations>
+class hive_page : public hive_page_base<T, NumSkipfields, Generations> {
 public:
 	constexpr ssize_t find_last() const noexcept {
-		for (auto i = hive_page_num_skipfields<T> - 1; i > 0; --i) {
-			auto count = std::countr_zero(this->_skipfields[i]);
-			if (count < 64) {
-				return (i << 6) + count;
+		for (auto i = NumSkipfields - 1; i >= 0; --i) {
+			if (this->_skipfields[i] != 0) {
+				return (i << 6) + (63 - std::countl_zero(this->_skipfields[i]));
 			}
 		}
 		return -1;
 	}
 
+	constexpr ssize_t size() const noexcept {
+		return this->_size;
+	}
+
+	constexpr bool full() const noexcept {
+		return this->_size == NumSkipfields * 64;
+	}
+
 	constexpr bool has(ssize_t index) const noexcept {
 		return (this->_skipfields[index >> 6] & (1_u64 << (index & 63))) != 0;
 	}
@@ -247,22 +347,50 @@ public:
 
 		this->data[index].destroy();
 		this->_skipfields[index >> 6] &= ~(1_u64 << (index & 63));
+		--this->_size;
+		if ((index >> 6) < this->_first_free_skipfield) {
+			this->_first_free_skipfield = index >> 6;
+		}
 	}
 
-	template <typename... Args>
-	constexpr ssize_t try_emplace(Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args...>) {
-		for (auto i = 0; i < hive_page_num_skipfields<T>; ++i) {
+	/**
+	 * @brief Destroys every element, leaving the page as if freshly constructed so it can be reused at another index.
+	 */
+	constexpr void clear() noexcept(std::is_nothrow_destructible_v<T>) {
+		for (ssize_t i = 0; i < NumSkipfields; ++i) {
+			if constexpr (!std::is_trivially_destructible_v<T>) {
+				for (auto live = this->_skipfields[i]; live != 0; live &= live - 1) {
+					this->data[(i << 6) | std::countr_zero(live)].destroy();
+				}
+			}
+			this->_skipfields[i] = 0;
+		}
+		this->_size = 0;
+		this->_first_free_skipfield = 0;
+	}
+
+	constexpr ssize_t find_free() noexcept {
+		// Every skipfield before `_first_free_skipfield` is known to be full
+		for (auto i = this->_first_free_skipfield; i < NumSkipfields; ++i) {
 			auto count = std::countr_one(this->_skipfields[i]);
 			if (count < 64) {
-				ssize_t index = (i << 6) | count;
-				this->data[index].emplace(std::forward<Args>(args)...);
-				this->_skipfields[i] |= (1_u64 << count);
-				return index;
+				this->_first_free_skipfield = i;
+				return (i << 6) | count;
 			}
 		}
+		this->_first_free_skipfield = NumSkipfields;
 		return -1;
 	}
 
+	template <typename... Args>
+	constexpr ssize_t try_emplace(Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args...>) {
+		auto index = find_free();
+		if (index >= 0) {
+			emplace_at(index, std::forward<Args>(args)...);
+		}
+		return index;
+	}
+
 	template <typename... Args>
 	void emplace_at(std::size_t index, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args...>) {
 		auto& skipfield = this->_skipfields[index >> 6];
@@ -271,6 +399,79 @@ public:
 		SHION_ASSERT((skipfield & flag) == 0);
 		this->data[index].emplace(std::forward<Args>(args)...);
 		skipfield |= flag;
+		++this->_size;
+	}
+
+	/**
+	 * @brief Constructs elements in free slots until `filled` reaches `count` or the page is full.
+	 *
+	 * @param filled Running count of constructed elements, incremented as each slot is filled.
+	 * @param count Target for `filled`.
+	 * @param construct Invoked with each free `hive_storage<T>` to construct the element in it.
+	 */
+	template <typename Fn>
+	constexpr void fill_n(ssize_t& filled, ssize_t count, Fn& construct) noexcept(std::is_nothrow_invocable_v<Fn&, hive_storage<T>&>) {
+		constexpr bool nothrow = std::is_nothrow_invocable_v<Fn&, hive_storage<T>&>;
+		auto i = this->_first_free_skipfield;
+
+		while (i < NumSkipfields && filled < count) {
+			auto& skipfield = this->_skipfields[i];
+
+			if (nothrow && skipfield == 0 && count - filled >= 64) {
+				for (ssize_t j = 0; j < 64; ++j) {
+					construct(this->data[(i << 6) | j]);
+				}
+				skipfield = ~0_u64;
+				this->_size += 64;
+				filled += 64;
+			} else {
+				for (auto free = ~skipfield; free != 0 && filled < count; free &= free - 1) {
+					auto j = std::countr_zero(free);
+					construct(this->data[(i << 6) | j]);
+					skipfield |= (1_u64 << j);
+					++this->_size;
+					++filled;
+				}
+			}
+			if (skipfield == ~0_u64) {
+				++i;
+			}
+		}
+		this->_first_free_skipfield = i;
+	}
+
+	/**
+	 * @brief Destroys every element for which `pred` returns true, one skipfield word at a time.
+	 *
+	 * @param erased Running count of erased elements, incremented after each word.
+	 * @param pred Predicate invoked with each live element.
+	 */
+	template <typename Pred>
+	constexpr void erase_if(ssize_t& erased, Pred& pred) {
+		for (ssize_t i = 0; i < NumSkipfields; ++i) {
+			uint64 mask = 0;
+
+			for (auto live = this->_skipfields[i]; live != 0; live &= live - 1) {
+				auto j = std::countr_zero(live);
+				if (std::invoke(pred, std::as_const(this->data[(i << 6) | j].value))) {
+					mask |= (1_u64 << j);
+				}
+			}
+			if (mask == 0) {
+				continue;
+			}
+			if constexpr (!std::is_trivially_destructible_v<T>) {
+				for (auto bits = mask; bits != 0; bits &= bits - 1) {
+					this->data[(i << 6) | std::countr_zero(bits)].destroy();
+				}
+			}
+			this->_skipfields[i] &= ~mask;
+			this->_size -= std::popcount(mask);
+			erased += std::popcount(mask);
+			if (i < this->_first_free_skipfield) {
+				this->_first_free_skipfield = i;
+			}
+		}
 	}
 
 	constexpr ssize_t find_at_least(ssize_t idx) const noexcept {
@@ -279,7 +480,7 @@ public:
 		if (count < 64)
 			return (skipfield_idx << 6) | count;
 		++skipfield_idx;
-		while (skipfield_idx < hive_page_num_skipfields<T>) {
+		while (skipfield_idx < NumSkipfields) {
 			count = std::countr_zero(this->_skipfields[skipfield_idx]);
 			if (count < 64)
 				return (skipfield_idx << 6) | count;
@@ -300,6 +501,21 @@ public:
 		return this->data[index].value;
 	}
 
+	/**
+	 * @brief Invokes `fn` with a span over each contiguous run of live elements.
+	 *
+	 * Runs never cross a skipfield word, so a span holds at most 64 elements, and exactly 64 when the word is full.
+	 */
+	template <typename Fn>
+	constexpr void for_each_segment(Fn& fn) {
+		_for_each_segment(*this, fn);
+	}
+
+	template <typename Fn>
+	constexpr void for_each_segment(Fn& fn) const {
+		_for_each_segment(*this, fn);
+	}
+
 	constexpr ssize_t get_from_address(std::add_const_t<T>* element) const noexcept {
 		intptr_t addr = reinterpret_cast<intptr_t>(element);
 		intptr_t start = reinterpret_cast<intptr_t>(this->data.data());
@@ -315,25 +531,162 @@ public:
 		}
 		return -1;
 	}
+
+private:
+	template <typename Self, typename Fn>
+	static constexpr void _for_each_segment(Self& self, Fn& fn) {
+		static_assert(sizeof(hive_storage<T>) == sizeof(T), "segments require hive_storage<T> to have the layout of T");
+		using element_t = std::conditional_t<std::is_const_v<Self>, T const, T>;
+
+		for (ssize_t i = 0; i < NumSkipfields; ++i) {
+			auto live = self._skipfields[i];
+
+			if (live == ~0_u64) {
+				std::invoke(fn, std::span<element_t>{std::addressof(self.data[i << 6].value), 64});
+				continue;
+			}
+			while (live != 0) {
+				auto start = std::countr_zero(live);
+				auto length = std::countr_one(live >> start);
+
+				std::invoke(fn, std::span<element_t>{std::addressof(self.data[(i << 6) | start].value), static_cast<size_t>(length)});
+				live = (start + length == 64) ? 0 : live & (~0_u64 << (start + length));
+			}
+		}
+	}
 };
 
 }
 
-SHION_EXPORT template <typename T>
+/**
+ * @brief Unordered container with stable element addresses, storing elements in fixed-size pages.
+ *
+ * @tparam PageSize Page size policy, see `hive_page_size`.
+ * @tparam Allocator Allocator for `T`, rebound to allocate pages and bookkeeping.
+ *                   Pages freed by `clear()` are kept in a pool and reused before asking the allocator for more.
+ * @tparam Handles Whether slots store a generation to support `handle`, see `handle_hive`.
+ */
+SHION_EXPORT template <typename T, typename PageSize, typename Allocator, bool Handles>
 class hive {
-	using page_iterator = typename std::list<detail::hive_page<T>>::iterator;
-	using page_riterator = typename std::list<detail::hive_page<T>>::reverse_iterator;
+	using page_t = detail::hive_page<T, detail::hive_page_num_skipfields<T, PageSize::target_size, Handles>, Handles>;
+	using page_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<page_t>;
+	using page_traits = std::allocator_traits<page_allocator>;
+
+	template <typename U>
+	using rebound_vector = std::vector<U, typename std::allocator_traits<Allocator>::template rebind_alloc<U>>;
+
+	static_assert(std::is_same_v<typename page_traits::pointer, page_t*>, "fancy pointers are not supported");
+	static_assert(lossless_cast<ssize_t>(sizeof(page_t)) <= PageSize::target_size || detail::hive_page_num_skipfields<T, PageSize::target_size, Handles> == 1, "page overhead was not budgeted for");
+
+	template <typename, typename>
+	friend struct detail::serializer::hive_serializer;
 
 public:
-	static inline constexpr auto elements_per_page = detail::hive_page_num_elements<T>;
-	
+	using allocator_type = Allocator;
+	using page_size = PageSize;
+
+	static inline constexpr auto elements_per_page = detail::hive_page_num_elements<T, PageSize::target_size, Handles>;
+
 	hive() = default;
-	hive(hive const& rhs) requires (std::is_copy_constructible_v<T>) = default;
-	hive(hive&& rhs) requires (std::is_move_constructible_v<T>) = default;
-	~hive() = default;
+	explicit hive(Allocator const& alloc) noexcept :
+		_allocator{alloc},
+		_page_directory(alloc),
+		_pages_by_address(alloc),
+		_free_pages(alloc),
+		_used_pages(alloc),
+		_page_pool(alloc) {
+	}
+	hive(hive const& rhs) requires (std::is_copy_constructible_v<T>) :
+		hive(std::allocator_traits<Allocator>::select_on_container_copy_construction(rhs.get_allocator())) {
+		_max_pooled_pages = rhs._max_pooled_pages;
+		_copy_pages(rhs);
+	}
+	hive(hive&& rhs) noexcept :
+		_size{std::exchange(rhs._size, 0)},
+		_last{std::exchange(rhs._last, -1)},
+		_first_free_page_word{std::exchange(rhs._first_free_page_word, 0)},
+		_first_hole_word{std::exchange(rhs._first_hole_word, 0)},
+		_page_count{std::exchange(rhs._page_count, 0)},
+		_next_generation{rhs._next_generation},
+		_max_pooled_pages{rhs._max_pooled_pages},
+		_allocator{std::move(rhs._allocator)},
+		_page_directory{std::move(rhs._page_directory)},
+		_pages_by_address{std::move(rhs._pages_by_address)},
+		_free_pages{std::move(rhs._free_pages)},
+		_used_pages{std::move(rhs._used_pages)},
+		_page_pool{std::move(rhs._page_pool)} {
+	}
+	~hive() {
+		clear();
+		_release_pooled_pages(0);
+	}
 
-	hive& operator=(hive const& rhs) requires (is_copyable<T>) = default;
-	hive& operator=(hive&& rhs) requires (is_moveable<T>) = default;
+	hive& operator=(hive const& rhs) requires (is_copyable<T>) {
+		if (this != &rhs) {
+			_max_pooled_pages = rhs._max_pooled_pages;
+			clear();
+			if constexpr (std::allocator_traits<Allocator>::propagate_on_container_copy_assignment::value) {
+				if (_allocator != rhs._allocator) {
+					// Pooled pages must go back to the allocator that made them
+					_release_pooled_pages(0);
+				}
+				_allocator = rhs._allocator;
+			}
+			_copy_pages(rhs);
+		}
+		return *this;
+	}
+	hive& operator=(hive&& rhs) noexcept(std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value || std::allocator_traits<Allocator>::is_always_equal::value) requires (is_moveable<T>) {
+		constexpr bool propagate = std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value;
+
+		if (this == &rhs) {
+			return *this;
+		}
+		_max_pooled_pages = rhs._max_pooled_pages;
+		clear();
+		if (propagate || _allocator == rhs._allocator) {
+			_release_pooled_pages(0);
+			if constexpr (propagate) {
+				_allocator = std::move(rhs._allocator);
+			}
+			_size = std::exchange(rhs._size, 0);
+			_last = std::exchange(rhs._last, -1);
+			_first_free_page_word = std::exchange(rhs._first_free_page_word, 0);
+			_first_hole_word = std::exchange(rhs._first_hole_word, 0);
+			_page_count = std::exchange(rhs._page_count, 0);
+			_next_generation = std::max(_next_generation, rhs._next_generation);
+			_page_directory = std::move(rhs._page_directory);
+			_pages_by_address = std::move(rhs._pages_by_address);
+			_free_pages = std::move(rhs._free_pages);
+			_used_pages = std::move(rhs._used_pages);
+			_page_pool = std::move(rhs._page_pool);
+			rhs._page_directory.clear();
+			rhs._pages_by_address.clear();
+			rhs._free_pages.clear();
+			rhs._used_pages.clear();
+			rhs._page_pool.clear();
+		} else {
+			// Allocators differ and do not propagate: pages cannot change hands, move the elements instead
+			_move_pages(rhs);
+			rhs.clear();
+		}
+		return *this;
+	}
+
+	/**
+	 * @brief Refers to an element by raw index, and detects when that element has been erased.
+	 *
+	 * Every construction of an element stamps its slot with a new generation taken from a counter shared by the hive,
+	 * so a handle to an erased element never matches whatever is constructed in its slot afterwards.
+	 * Handles survive `compact` if their index is updated from the relocation callback.
+	 * Only available in hives with `Handles` enabled.
+	 */
+	struct handle {
+		ssize_t index{-1};
+		uint32  generation{};
+
+		friend constexpr bool operator==(handle const&, handle const&) noexcept = default;
+	};
 
 	template <value_type ValueType>
 	class basic_iterator {
@@ -353,18 +706,18 @@ public:
 		constexpr basic_iterator operator++(int) const noexcept {
 			SHION_ASSERT(_is_valid_hive_iterator());
 
-			return _find_at_least(_hive, _current_page_it, _index + 1);
+			return _find_at_least(_hive, _index + 1);
 		}
 
 		constexpr basic_iterator& operator++() noexcept {
 			SHION_ASSERT(_is_valid_hive_iterator());
 
-			*this = _find_at_least(_hive, _current_page_it, _index + 1);
+			*this = _find_at_least(_hive, _index + 1);
 			return {*this};
 		}
 
 		constexpr decltype(auto) operator*() const noexcept {
-			return forward_like_type<ValueType>(_current_page_it->retrieve(_index - _current_page_it->global_index_of_first));
+			return forward_like_type<ValueType>(_current_page->retrieve(_index - _current_page->global_index_of_first));
 		}
 
 		constexpr auto operator->() const noexcept {
@@ -381,29 +734,32 @@ public:
 			return _index;
 		}
 
+		constexpr handle to_handle() const noexcept requires (Handles) {
+			SHION_ASSERT(_is_valid_hive_iterator());
+
+			return {_index, _current_page->_generations[_index - _current_page->global_index_of_first]};
+		}
+
 	private:
 		friend class hive;
 
-		constexpr static basic_iterator _find_at_least(hive *h, page_iterator page_start, ssize_t index) noexcept {
+		constexpr static basic_iterator _find_at_least(hive *h, ssize_t index) noexcept {
 			if (index > h->_last) {
 				return {};
 			}
-			page_iterator         page_it = page_start;
+			auto page_count = std::ssize(h->_page_directory);
+			for (ssize_t page_idx = index / elements_per_page; page_idx < page_count; ++page_idx) {
+				page_t* page = h->_page_directory[page_idx];
 
-			while (true) {
-				SHION_ASSERT(page_it != h->_pages.end()); // Should have been caught by `_index > h->_last` -- `h->_last` is wrong -- race condition?
-				ssize_t idx_in_page = index - page_it->global_index_of_first;
-				if (idx_in_page < detail::hive_page_num_elements<T>) {
-					if (idx_in_page < 0) {
-						idx_in_page = 0;
-					}
-					idx_in_page = page_it->find_at_least(idx_in_page);
-					if (idx_in_page >= 0) {
-						return {h, page_it, idx_in_page + page_it->global_index_of_first};
-					}
+				if (page == nullptr) {
+					continue;
+				}
+				ssize_t idx_in_page = page->find_at_least(std::max(index - page->global_index_of_first, 0_sst));
+				if (idx_in_page >= 0) {
+					return {h, page, idx_in_page + page->global_index_of_first};
 				}
-				++page_it;
 			}
+			SHION_ASSERT(false); // Should have been caught by `_index > h->_last` -- `h->_last` is wrong -- race condition?
 			return {};
 		}
 
@@ -414,18 +770,18 @@ public:
 		constexpr basic_iterator(std::nullptr_t) = delete;
 
 		constexpr basic_iterator(hive* h) noexcept :
-			basic_iterator(_find_at_least(h, h->_pages.begin(), 0)) {
+			basic_iterator(_find_at_least(h, 0)) {
 		}
 
-		constexpr basic_iterator(hive* h, page_iterator l, ssize_t i) noexcept :
+		constexpr basic_iterator(hive* h, page_t* p, ssize_t i) noexcept :
 			_index{i},
 			_hive{h},
-			_current_page_it{l} {
+			_current_page{p} {
 		}
 
-		ssize_t       _index{-1};
-		hive*         _hive{nullptr};
-		page_iterator _current_page_it{};
+		ssize_t _index{-1};
+		hive*   _hive{nullptr};
+		page_t* _current_page{nullptr};
 	};
 
 	using iterator = basic_iterator<value_type::lvalue_reference>;
@@ -466,30 +822,26 @@ public:
 	template <typename... Args>
 	requires (std::constructible_from<T, Args...>)
 	constexpr iterator emplace(Args&&... args) {
-		iterator result{};
-		page_iterator                          page_it;
-		ssize_t first_in_page = 0;
-
-		for (page_it = _pages.begin(); page_it != _pages.end(); ++page_it) {
-			first_in_page = page_it->global_index_of_first;
-			if (auto idx = page_it->try_emplace(std::forward<Args>(args)...); idx >= 0) {
-				auto global_idx = first_in_page + idx;
-				result = {this, page_it, global_idx};
-				++_size;
-				if (global_idx > _last)
-					_last = global_idx;
-				return result;
-			}
-			first_in_page += detail::hive_page_num_elements<T>;
-		}
-
-		page_it = _pages.emplace(_pages.end());
-		page_it->global_index_of_first = first_in_page;
-		page_it->emplace_at(0, std::forward<Args>(args)...);
-		result = {this, page_it, first_in_page};
+		if (page_t* page = _find_free_page(); page != nullptr) {
+			auto idx = page->try_emplace(std::forward<Args>(args)...);
+			SHION_ASSERT(idx >= 0); // Page was marked as free but is full
+			_stamp(page, idx);
+			auto global_idx = page->global_index_of_first + idx;
+			if (page->full())
+				_set_page_free(global_idx / elements_per_page, false);
+			++_size;
+			if (global_idx > _last)
+				_last = global_idx;
+			return {this, page, global_idx};
+		}
+
+		page_t* page = _make_page(_find_hole());
+		page->emplace_at(0, std::forward<Args>(args)...);
+		_stamp(page, 0);
 		++_size;
-		_last = first_in_page;
-		return result;
+		if (page->global_index_of_first > _last)
+			_last = page->global_index_of_first;
+		return {this, page, page->global_index_of_first};
 	}
 
 	template <typename... Args>
@@ -497,67 +849,313 @@ public:
 	constexpr std::pair<iterator, bool> try_emplace(ssize_t idx, Args&&... args) {
 		SHION_ASSERT(idx >= 0);
 
-		auto it = _pages.begin();
-		ssize_t page_end = 0;
-		ssize_t index_in_page = idx;
-		while (it != _pages.end()) {
-			if (idx < it->global_index_of_first) {
-				// idx is after previous page, before this page
-				break;
-			}
-			page_end = it->global_index_of_first + detail::hive_page_num_elements<T>;
+		page_t* page = _get_page(idx);
+		if (page == nullptr) {
+			page = _make_page(idx / elements_per_page);
+		}
 
-			if (idx >= page_end) {
-				++it;
-				continue;
-			}
-			// idx is in this page
-			index_in_page = idx - it->global_index_of_first;
-			if (it->has(index_in_page)) {
-				return {
-					iterator{this, it, idx},
-					false
-				};
-			} else {
-				it->emplace_at(index_in_page, std::forward<Args>(args)...);
-				++_size;
-				if (idx > _last)
-					_last = idx;
-				return {
-					iterator{this, it, idx},
-					true
-				};
-			}
-		}
-		if (idx >= page_end + detail::hive_page_num_elements<T>) {
-				index_in_page = idx % detail::hive_page_num_elements<T>;
-				page_end = idx - index_in_page;
-		}
-		it = _pages.emplace(it);
-		it->global_index_of_first = page_end;
-		it->emplace_at(index_in_page, std::forward<Args>(args)...);
+		ssize_t index_in_page = idx - page->global_index_of_first;
+		if (page->has(index_in_page)) {
+			return {
+				iterator{this, page, idx},
+				false
+			};
+		}
+		page->emplace_at(index_in_page, std::forward<Args>(args)...);
+		_stamp(page, index_in_page);
+		if (page->full())
+			_set_page_free(idx / elements_per_page, false);
 		++_size;
 		if (idx > _last)
 			_last = idx;
 		return {
-			iterator{this, it, idx},
+			iterator{this, page, idx},
 			true
 		};
 	}
 
-	constexpr iterator get_iterator(std::add_const_t<T>* element) noexcept {
-		// We cast all pointers to intptr_t because comparing incompatible pointers is undefined behavior
-		intptr_t as_int = reinterpret_cast<intptr_t>(element);
+	template <typename... Args>
+	requires (std::constructible_from<T, Args const&...>)
+	constexpr void emplace_n(ssize_t count, Args const&... args) {
+		auto construct = [&args...](detail::hive_storage<T>& slot) noexcept(std::is_nothrow_constructible_v<T, Args const&...>) {
+			slot.emplace(args...);
+		};
+
+		_fill_n(count, construct);
+	}
 
-		for (page_iterator page_it = _pages.begin(); page_it != _pages.end(); ++page_it) {
-			intptr_t begin_as_int = reinterpret_cast<intptr_t>(&(*page_it->data.begin()));
-			intptr_t end_as_int = reinterpret_cast<intptr_t>(&(*page_it->data.rbegin())) + 1;
+	template <std::ranges::input_range R>
+	requires (std::constructible_from<T, std::ranges::range_reference_t<R>>)
+	constexpr void insert(R&& range) {
+		if constexpr (std::ranges::sized_range<R> || std::ranges::forward_range<R>) {
+			auto count = lossless_cast<ssize_t>(std::ranges::distance(range));
+			auto it = std::ranges::begin(range);
+			// noexcept lets fill_n construct whole skipfield words at once
+			auto construct = [&it](detail::hive_storage<T>& slot) noexcept(std::is_nothrow_constructible_v<T, std::ranges::range_reference_t<R>> && noexcept(*it) && noexcept(++it)) {
+				slot.emplace(*it);
+				++it;
+			};
 
-			if (as_int >= begin_as_int && as_int < end_as_int) {
-				if (auto idx = page_it->get_from_address(element); idx >= 0) {
-					return {this, page_it, page_it->global_index_of_first + idx};
+			_fill_n(count, construct);
+		} else {
+			for (auto&& value : range) {
+				emplace(std::forward<decltype(value)>(value));
+			}
+		}
+	}
+
+	template <typename Pred>
+	requires (std::predicate<Pred&, T const&>)
+	constexpr ssize_t erase_if(Pred pred) {
+		ssize_t erased = 0;
+		page_t* page = nullptr;
+		and_then commit = [&]() noexcept {
+			if (page != nullptr)
+				_update_erased_page(page);
+			_size -= erased;
+			if (erased > 0)
+				_update_last(std::ssize(_page_directory) - 1);
+		};
+
+		for (page_t* p : _page_directory) {
+			if (p == nullptr || p->size() == 0) {
+				continue;
+			}
+			page = p;
+			page->erase_if(erased, pred);
+			_update_erased_page(page);
+			page = nullptr;
+		}
+		return erased;
+	}
+
+	/**
+	 * @brief Moves elements from the last pages into free slots of the first pages, until no free slot is left before them.
+	 *
+	 * Afterwards the elements occupy raw indices `[0, size())`, which packs them densely for iteration.
+	 * Empty page slots are filled with pages taken from the pool.
+	 * Pages emptied by the pass are pooled like any other empty page, see `trim` and `shrink_to_fit`.
+	 * Iterators and pointers to relocated elements are invalidated.
+	 *
+	 * @param on_relocate Invoked with the old and the new raw index of each relocated element, after it has moved.
+	 * @return Number of elements relocated.
+	 */
+	template <typename Fn>
+	requires (std::is_move_constructible_v<T> && std::invocable<Fn&, ssize_t, ssize_t>)
+	constexpr ssize_t compact(Fn on_relocate) {
+		ssize_t relocated = 0;
+		ssize_t hole = 0; // Every directory slot before `hole` holds a page
+		page_t* src = nullptr;
+		// Also runs if a move constructor or `on_relocate` throws
+		and_then commit = [&]() noexcept {
+			if (src != nullptr)
+				_update_erased_page(src);
+			if (relocated > 0)
+				_update_last(std::ssize(_page_directory) - 1);
+		};
+
+		// The last page packed may be the first free one, possibly page 0, and is then packed into itself
+		for (auto src_page_idx = std::ssize(_page_directory) - 1; src_page_idx >= 0; --src_page_idx) {
+			if (_page_directory[src_page_idx] == nullptr) {
+				continue;
+			}
+			src = _page_directory[src_page_idx];
+			for (ssize_t i = src->find_at_least(0); i >= 0; i = (i + 1 < elements_per_page ? src->find_at_least(i + 1) : -1)) {
+				// The free page with the lowest index, anything before it is full or missing
+				page_t* dst = _find_free_page();
+				auto    dst_page_idx = dst != nullptr ? dst->global_index_of_first / elements_per_page : src_page_idx + 1;
+
+				while (hole < std::min(dst_page_idx, src_page_idx) && _page_directory[hole] != nullptr) {
+					++hole;
+				}
+				if (hole < std::min(dst_page_idx, src_page_idx)) {
+					dst = _make_page(hole);
+					dst_page_idx = hole;
+				}
+				if (dst_page_idx > src_page_idx) {
+					return relocated;
+				}
+				auto idx_in_dst = dst->find_free();
+				SHION_ASSERT(idx_in_dst >= 0); // Page was marked as free but is full
+				if (dst == src && idx_in_dst > i) {
+					// Packing the last page to the front, every slot up to `i` is taken
+					continue;
+				}
+				dst->emplace_at(idx_in_dst, std::move(src->retrieve(i)));
+				if constexpr (Handles) {
+					dst->_generations[idx_in_dst] = src->_generations[i]; // Handles only need their index fixed up
+				}
+				if (dst != src && dst->full())
+					_set_page_free(dst_page_idx, false);
+				src->erase(i);
+				++relocated;
+				std::invoke(on_relocate, src->global_index_of_first + i, dst->global_index_of_first + idx_in_dst);
+			}
+			_update_erased_page(src);
+			src = nullptr;
+		}
+		return relocated;
+	}
+
+	constexpr ssize_t compact() requires (std::is_move_constructible_v<T>) {
+		return compact([](ssize_t, ssize_t) noexcept {});
+	}
+
+	/**
+	 * @brief Invokes `fn` with a `std::span<T>` over each contiguous run of live elements, in raw index order.
+	 *
+	 * Faster than iterating element by element: skipfields are decoded once per run instead of once per element,
+	 * and dense runs of up to 64 elements can be processed in a tight loop the compiler can vectorize.
+	 */
+	template <typename Fn>
+	requires (std::invocable<Fn&, std::span<T>>)
+	constexpr void for_each_segment(Fn fn) {
+		for (page_t* page : _page_directory) {
+			if (page != nullptr && page->size() > 0) {
+				page->for_each_segment(fn);
+			}
+		}
+	}
+
+	template <typename Fn>
+	requires (std::invocable<Fn&, std::span<T const>>)
+	constexpr void for_each_segment(Fn fn) const {
+		for (page_t const* page : _page_directory) {
+			if (page != nullptr && page->size() > 0) {
+				page->for_each_segment(fn);
+			}
+		}
+	}
+
+	template <typename Fn>
+	requires (std::invocable<Fn&, T&>)
+	constexpr void for_each(Fn fn) {
+		for_each_segment([&fn](std::span<T> segment) {
+			for (T& value : segment) {
+				std::invoke(fn, value);
+			}
+		});
+	}
+
+	template <typename Fn>
+	requires (std::invocable<Fn&, T const&>)
+	constexpr void for_each(Fn fn) const {
+		for_each_segment([&fn](std::span<T const> segment) {
+			for (T const& value : segment) {
+				std::invoke(fn, value);
+			}
+		});
+	}
+
+	/**
+	 * @brief Invokes `fn` on every element, splitting the work by page across `num_jobs` jobs.
+	 *
+	 * `num_jobs - 1` jobs are handed to `executor`, which must eventually run each of them on some thread;
+	 * the calling thread runs the last one and then blocks until all jobs are done.
+	 * Jobs claim whole pages one at a time, so no two threads touch the same page.
+	 * `fn` is shared by all jobs and must be safe to call concurrently.
+	 * If `fn` throws, the remaining pages are skipped and the first exception is rethrown on the calling thread.
+	 * If `executor` throws, the jobs it was already given are stopped and waited for before its exception is rethrown;
+	 * it must not have run the job it throws for.
+	 *
+	 * @param executor Invoked with each job, a callable object taking no arguments.
+	 * @param num_jobs Number of jobs to split the work into, including the one run on the calling thread.
+	 * @param fn Invoked with each element.
+	 */
+	template <typename Executor, typename Fn>
+	requires (std::invocable<Fn&, T&>)
+	void parallel_for_each(Executor&& executor, ssize_t num_jobs, Fn fn) {
+		struct shared_state {
+			explicit shared_state(ssize_t jobs) : done{jobs} {}
+
+			std::latch           done;
+			std::atomic<ssize_t> next_page{0};
+			std::atomic<bool>    failed{false};
+			std::exception_ptr   exception{};
+			std::once_flag       exception_flag{};
+		};
+
+		SHION_ASSERT(num_jobs > 0);
+
+		std::vector<page_t*> pages;
+		pages.reserve(_page_count);
+		for (page_t* page : _page_directory) {
+			if (page != nullptr && page->size() > 0) {
+				pages.push_back(page);
+			}
+		}
+
+		auto state = std::make_shared<shared_state>(num_jobs);
+		auto job = [state, &pages, &fn]() noexcept {
+			auto for_each = [&fn](std::span<T> segment) {
+				for (T& value : segment) {
+					std::invoke(fn, value);
+				}
+			};
+
+			try {
+				for (auto i = state->next_page.fetch_add(1, std::memory_order_relaxed); i < std::ssize(pages); i = state->next_page.fetch_add(1, std::memory_order_relaxed)) {
+					if (state->failed.load(std::memory_order_relaxed)) {
+						break;
+					}
+					pages[i]->for_each_segment(for_each);
 				}
+			} catch (...) {
+				std::call_once(state->exception_flag, [&state]() { state->exception = std::current_exception(); });
+				state->failed.store(true, std::memory_order_relaxed);
 			}
+			state->done.count_down();
+		};
+
+		// Jobs refer to `pages` and `fn`, so every path waits for them before leaving this frame
+		for (ssize_t i = 1; i < num_jobs; ++i) {
+			try {
+				std::invoke(executor, job);
+			} catch (...) {
+				state->failed.store(true, std::memory_order_relaxed);
+				// Count down for this job, the ones never handed out, and the one the calling thread would have run
+				state->done.count_down(num_jobs - i + 1);
+				state->done.wait();
+				throw;
+			}
+		}
+		job();
+		state->done.wait();
+		if (state->exception) {
+			std::rethrow_exception(state->exception);
+		}
+	}
+
+	/**
+	 * @brief Invokes `fn` on every element using `num_threads` threads, including the calling thread.
+	 *
+	 * @see parallel_for_each(Executor&&, ssize_t, Fn)
+	 */
+	template <typename Fn>
+	requires (std::invocable<Fn&, T&>)
+	void parallel_for_each(ssize_t num_threads, Fn fn) {
+		SHION_ASSERT(num_threads > 0);
+
+		std::vector<std::jthread> threads;
+
+		threads.reserve(static_cast<size_t>(std::max(num_threads - 1, 0_sst)));
+		parallel_for_each([&threads](auto const& job) { threads.emplace_back(job); }, num_threads, std::move(fn));
+	}
+
+	/**
+	 * @brief Finds the element at `element`, in O(log pages). Returns `end()` if it is not an element of this hive.
+	 */
+	constexpr iterator get_iterator(std::add_const_t<T>* element) noexcept {
+		// The last page starting at or before `element` is the only one that can hold it.
+		// It may be an empty pooled page, whose skipfields reject every address.
+		auto it = std::ranges::upper_bound(_pages_by_address, _address_of(element), std::less{}, &hive::_address_of<page_t>);
+
+		if (it == _pages_by_address.begin()) {
+			return {};
+		}
+		page_t* page = *std::prev(it);
+		if (auto idx = page->get_from_address(element); idx >= 0) {
+			return {this, page, page->global_index_of_first + idx};
 		}
 		return {};
 	}
@@ -566,11 +1164,41 @@ public:
 		if (size() == 0 || index > _last)
 			return end();
 
-		auto page_it = _get_page(index);
-		if (page_it == _pages.end() || !page_it->has(index - page_it->global_index_of_first)) {
+		page_t* page = _get_page(index);
+		if (page == nullptr || !page->has(index - page->global_index_of_first)) {
+			return end();
+		}
+		return {this, page, index};
+	}
+
+	/**
+	 * @brief Finds the element referred to by `h` in O(1). Returns `end()` if it has been erased since `h` was made.
+	 */
+	constexpr iterator find(handle h) noexcept requires (Handles) {
+		if (h.index < 0 || h.index > _last)
+			return end();
+
+		page_t* page = _get_page(h.index);
+		if (page == nullptr) {
+			return end();
+		}
+		auto index_in_page = h.index - page->global_index_of_first;
+		if (!page->has(index_in_page) || page->_generations[index_in_page] != h.generation) {
 			return end();
 		}
-		return {this, page_it, index};
+		return {this, page, h.index};
+	}
+
+	/**
+	 * @brief Returns a pointer to the element referred to by `h`, or nullptr if it has been erased since `h` was made.
+	 */
+	constexpr T* get(handle h) noexcept requires (Handles) {
+		auto it = find(h);
+		return it == end() ? nullptr : std::addressof(*it);
+	}
+
+	constexpr T const* get(handle h) const noexcept requires (Handles) {
+		return const_cast<hive*>(this)->get(h);
 	}
 
 	constexpr auto erase(basic_iterator<value_type::lvalue_reference> it) noexcept(std::is_nothrow_destructible_v<T>) -> basic_iterator<value_type::lvalue_reference> {
@@ -581,20 +1209,99 @@ public:
 		return _erase(it);
 	}
 
+	/**
+	 * @brief Destroys every element. Pages are kept in the pool for reuse rather than freed.
+	 */
 	constexpr void clear() noexcept(std::is_nothrow_destructible_v<T>) {
-		_pages.clear();
+		for (page_t* page : _page_directory) {
+			if (page != nullptr) {
+				page->clear();
+				_page_pool.push_back(page); // Never reallocates, see `_make_page`
+			}
+		}
+		_page_directory.clear();
+		_free_pages.clear();
+		_used_pages.clear();
+		_first_free_page_word = 0;
+		_first_hole_word = 0;
+		_page_count = 0;
+		_size = 0;
+		_last = -1;
+		_apply_pool_limit();
+	}
+
+	/**
+	 * @brief Returns pooled pages to the allocator until at most `max_empty_pages` remain.
+	 *
+	 * Pages are pooled when they become empty, whether through `erase`, `erase_if` or `clear`.
+	 */
+	constexpr void trim(ssize_t max_empty_pages) noexcept {
+		SHION_ASSERT(max_empty_pages >= 0);
+
+		_release_pooled_pages(max_empty_pages);
+	}
+
+	/**
+	 * @brief Returns every pooled page to the allocator and shrinks the page directory to the last used page.
+	 */
+	constexpr void shrink_to_fit() {
+		trim(0);
+		while (!_page_directory.empty() && _page_directory.back() == nullptr) {
+			_page_directory.pop_back();
+		}
+		_free_pages.resize((_page_directory.size() + 63) / 64);
+		_used_pages.resize(_free_pages.size());
+		_first_free_page_word = std::min(_first_free_page_word, std::ssize(_free_pages));
+		_first_hole_word = std::min(_first_hole_word, std::ssize(_used_pages));
+		_page_directory.shrink_to_fit();
+		_pages_by_address.shrink_to_fit();
+		_free_pages.shrink_to_fit();
+		_used_pages.shrink_to_fit();
+
+		// The pool must keep room for every page we own, see `_make_page`
+		if (_page_pool.capacity() > static_cast<size_t>(_page_count)) {
+			rebound_vector<page_t*> pool(_page_pool.get_allocator());
+
+			pool.reserve(_page_count);
+			_page_pool.swap(pool);
+		}
+	}
+
+	/**
+	 * @brief Sets how many empty pages the pool may hold before returning pages to the allocator.
+	 *
+	 * Once the pool grows past `max_empty_pages`, it is trimmed down to half of that,
+	 * so a workload hovering around a page boundary does not allocate and free a page on every operation.
+	 * The pool is unbounded by default.
+	 */
+	constexpr void set_max_pooled_pages(ssize_t max_empty_pages) noexcept {
+		SHION_ASSERT(max_empty_pages >= 0);
+
+		_max_pooled_pages = max_empty_pages;
+		_apply_pool_limit();
+	}
+
+	constexpr ssize_t max_pooled_pages() const noexcept {
+		return _max_pooled_pages;
+	}
+
+	constexpr allocator_type get_allocator() const noexcept {
+		return allocator_type{_allocator};
 	}
 
 	constexpr ssize_t capacity() const noexcept {
-		return shion::lossless_cast<ssize_t>(detail::hive_page_num_elements<T> * _pages.size());
+		return elements_per_page * _page_count;
 	}
 
 	constexpr ssize_t size() const noexcept {
 		return _size;
 	}
 
+	/**
+	 * @brief Memory held by pages, including pooled pages that hold no elements.
+	 */
 	constexpr ssize_t size_bytes() const noexcept {
-		return pages() * page_size_bytes();
+		return (pages() + pooled_pages()) * page_size_bytes();
 	}
 
 	constexpr ssize_t last_raw_index() const noexcept {
@@ -602,47 +1309,289 @@ public:
 	}
 
 	constexpr ssize_t pages() const noexcept {
-		return _pages.size();
+		return _page_count;
+	}
+
+	constexpr ssize_t pooled_pages() const noexcept {
+		return std::ssize(_page_pool);
 	}
 
 	constexpr ssize_t page_size_bytes() const noexcept {
-		return sizeof(detail::hive_page<T>);
+		return sizeof(page_t);
 	}
 
 	constexpr ssize_t page_capacity() const noexcept {
-		return detail::hive_page_num_elements<T>;
+		return elements_per_page;
 	}
 
 private:
-	constexpr auto _get_page(ssize_t idx) const noexcept {
-		auto page_it = _pages.begin();
-		while (page_it != _pages.end()) {
-			if (idx - page_it->global_index_of_first < detail::hive_page_num_elements<T>) {
-				return page_it;
+	constexpr page_t const* _get_page(ssize_t idx) const noexcept {
+		auto page_idx = idx / elements_per_page;
+
+		return page_idx < std::ssize(_page_directory) ? _page_directory[page_idx] : nullptr;
+	}
+
+	constexpr page_t* _get_page(ssize_t idx) noexcept {
+		auto page_idx = idx / elements_per_page;
+
+		return page_idx < std::ssize(_page_directory) ? _page_directory[page_idx] : nullptr;
+	}
+
+	constexpr page_t* _make_page(ssize_t page_idx) {
+		SHION_ASSERT(page_idx >= std::ssize(_page_directory) || _page_directory[page_idx] == nullptr);
+
+		if (page_idx >= std::ssize(_page_directory)) {
+			_page_directory.resize(page_idx + 1, nullptr);
+			_free_pages.resize((_page_directory.size() + 63) / 64);
+			_used_pages.resize(_free_pages.size());
+		}
+
+		page_t* page;
+		if (!_page_pool.empty()) {
+			// Pooled pages stay in `_pages_by_address`
+			page = _page_pool.back();
+			_page_pool.pop_back();
+		} else {
+			auto owned = static_cast<size_t>(_page_count + 1);
+
+			// Keep room in the pool for every page we own, so `clear()` can return pages to it without allocating
+			if (_page_pool.capacity() < owned) {
+				_page_pool.reserve(std::max(owned, _page_pool.capacity() * 2));
 			}
-			++page_it;
+			// Reserve up front so inserting the page below cannot throw
+			if (_pages_by_address.capacity() < owned) {
+				_pages_by_address.reserve(std::max(owned, _pages_by_address.capacity() * 2));
+			}
+			page = _allocate_page();
+			_pages_by_address.insert(std::ranges::upper_bound(_pages_by_address, _address_of(page), std::less{}, &hive::_address_of<page_t>), page);
+		}
+		page->global_index_of_first = page_idx * elements_per_page;
+		_page_directory[page_idx] = page;
+		_used_pages[page_idx >> 6] |= (1_u64 << (page_idx & 63));
+		++_page_count;
+		_set_page_free(page_idx, true);
+		return page;
+	}
+
+	// We cast all pointers to intptr_t because comparing pointers to different objects is unspecified
+	template <typename U>
+	static intptr_t _address_of(U const* ptr) noexcept {
+		return reinterpret_cast<intptr_t>(ptr);
+	}
+
+	constexpr page_t* _allocate_page() {
+		page_t* page = page_traits::allocate(_allocator, 1);
+
+		try {
+			page_traits::construct(_allocator, page);
+		} catch (...) {
+			page_traits::deallocate(_allocator, page, 1);
+			throw;
+		}
+		return page;
+	}
+
+	constexpr void _apply_pool_limit() noexcept {
+		if (std::ssize(_page_pool) > _max_pooled_pages) {
+			_release_pooled_pages(_max_pooled_pages / 2);
 		}
-		return _pages.end();
 	}
 
-	constexpr auto _get_page(ssize_t idx) noexcept {
-		auto page_it = _pages.begin();
-		while (page_it != _pages.end()) {
-			if (idx - page_it->global_index_of_first < detail::hive_page_num_elements<T>) {
-				return page_it;
+	/**
+	 * @brief Moves an empty page from the directory to the pool.
+	 */
+	constexpr void _retire_page(page_t* page) noexcept {
+		SHION_ASSERT(page->size() == 0);
+
+		auto page_idx = page->global_index_of_first / elements_per_page;
+
+		_set_page_free(page_idx, false);
+		_page_directory[page_idx] = nullptr;
+		_used_pages[page_idx >> 6] &= ~(1_u64 << (page_idx & 63));
+		if ((page_idx >> 6) < _first_hole_word)
+			_first_hole_word = page_idx >> 6;
+		--_page_count;
+		_page_pool.push_back(page); // Never reallocates, see `_make_page`
+		_apply_pool_limit();
+	}
+
+	constexpr void _release_pooled_pages(ssize_t keep) noexcept {
+		if (std::ssize(_page_pool) <= keep)
+			return;
+
+		auto released = std::ranges::subrange(_page_pool.begin() + keep, _page_pool.end());
+
+		// With both sorted by address, a single pass drops every released page from `_pages_by_address`
+		std::ranges::sort(released, std::less{}, &hive::_address_of<page_t>);
+		auto next = released.begin();
+		auto out = _pages_by_address.begin();
+		for (page_t* page : _pages_by_address) {
+			if (next != released.end() && *next == page) {
+				++next;
+			} else {
+				*out++ = page;
 			}
-			++page_it;
 		}
-		return _pages.end();
+		_pages_by_address.erase(out, _pages_by_address.end());
+		for (page_t* page : released) {
+			page_traits::destroy(_allocator, page);
+			page_traits::deallocate(_allocator, page, 1);
+		}
+		_page_pool.erase(released.begin(), released.end());
+	}
+
+	/**
+	 * @brief Copies the pages of `rhs` into this hive, which must be empty.
+	 */
+	constexpr void _copy_pages(hive const& rhs) {
+		_transfer_pages(rhs, [](page_t& lhs_page, page_t const& rhs_page) { lhs_page = rhs_page; });
+	}
+
+	/**
+	 * @brief Moves the elements of `rhs` into pages of this hive, which must be empty.
+	 */
+	constexpr void _move_pages(hive& rhs) {
+		_transfer_pages(rhs, [](page_t& lhs_page, page_t& rhs_page) { lhs_page = std::move(rhs_page); });
+	}
+
+	template <typename Hive, typename Fn>
+	constexpr void _transfer_pages(Hive& rhs, Fn transfer) {
+		SHION_ASSERT(_page_count == 0);
+
+		bool success = false;
+		and_then rollback = [&]() noexcept {
+			if (!success)
+				clear();
+		};
+
+		_page_directory.reserve(rhs._page_directory.size());
+		for (auto* rhs_page : rhs._page_directory) {
+			if (rhs_page == nullptr) {
+				continue;
+			}
+			auto    page_idx = rhs_page->global_index_of_first / elements_per_page;
+			page_t* page = _make_page(page_idx);
+
+			transfer(*page, *rhs_page);
+			_size += page->size();
+			_set_page_free(page_idx, !page->full());
+		}
+		_last = rhs._last;
+		_next_generation = std::max(_next_generation, rhs._next_generation);
+		success = true;
+	}
+
+	constexpr page_t* _find_free_page() noexcept {
+		// Every word before `_first_free_page_word` is known to be 0
+		for (auto i = _first_free_page_word; i < std::ssize(_free_pages); ++i) {
+			if (_free_pages[i] != 0) {
+				_first_free_page_word = i;
+				return _page_directory[(i << 6) | std::countr_zero(_free_pages[i])];
+			}
+		}
+		_first_free_page_word = std::ssize(_free_pages);
+		return nullptr;
+	}
+
+	/**
+	 * @brief Returns the lowest directory index that holds no page, which may be one past the end of the directory.
+	 */
+	constexpr ssize_t _find_hole() noexcept {
+		// Every word before `_first_hole_word` is known to be full
+		for (auto i = _first_hole_word; i < std::ssize(_used_pages); ++i) {
+			if (_used_pages[i] != ~0_u64) {
+				_first_hole_word = i;
+				return (i << 6) | std::countr_one(_used_pages[i]);
+			}
+		}
+		_first_hole_word = std::ssize(_used_pages);
+		return std::ssize(_used_pages) << 6;
+	}
+
+	constexpr void _set_page_free(ssize_t page_idx, bool free) noexcept {
+		auto flag = (1_u64 << (page_idx & 63));
+
+		if (free) {
+			_free_pages[page_idx >> 6] |= flag;
+			if ((page_idx >> 6) < _first_free_page_word)
+				_first_free_page_word = page_idx >> 6;
+		} else {
+			_free_pages[page_idx >> 6] &= ~flag;
+		}
+	}
+
+	template <typename Fn>
+	constexpr void _fill_n(ssize_t count, Fn& construct) {
+		ssize_t filled = 0;
+		page_t* page = nullptr;
+		// Also runs if a constructor throws halfway through a page
+		and_then commit = [&]() noexcept {
+			if (page != nullptr)
+				_update_filled_page(page);
+			_size += filled;
+		};
+		auto construct_and_stamp = [&](detail::hive_storage<T>& slot) noexcept(std::is_nothrow_invocable_v<Fn&, detail::hive_storage<T>&>) {
+			construct(slot);
+			_stamp(page, &slot - page->data.data());
+		};
+
+		while (filled < count) {
+			if (page != nullptr)
+				_update_filled_page(page);
+			page = _find_free_page();
+			if (page == nullptr) {
+				page = _make_page(_find_hole());
+			}
+			page->fill_n(filled, count, construct_and_stamp);
+		}
+	}
+
+	/**
+	 * @brief Gives the element just constructed at `idx` in `page` a new generation, if the hive has handles.
+	 */
+	constexpr void _stamp(page_t* page, ssize_t idx) noexcept {
+		if constexpr (Handles) {
+			page->_generations[idx] = _next_generation++;
+		}
+	}
+
+	constexpr void _update_filled_page(page_t* page) noexcept {
+		if (page->full())
+			_set_page_free(page->global_index_of_first / elements_per_page, false);
+		if (auto last = page->find_last(); last >= 0 && last + page->global_index_of_first > _last)
+			_last = last + page->global_index_of_first;
+	}
+
+	constexpr void _update_erased_page(page_t* page) noexcept {
+		if (page->size() == 0)
+			_retire_page(page);
+		else if (!page->full())
+			_set_page_free(page->global_index_of_first / elements_per_page, true);
+	}
+
+	constexpr void _update_last(ssize_t from_page) noexcept {
+		for (ssize_t page_idx = from_page; page_idx >= 0; --page_idx) {
+			page_t* page = _page_directory[page_idx];
+
+			if (page == nullptr) {
+				continue;
+			}
+			if (auto last = page->find_last(); last >= 0) {
+				_last = last + page->global_index_of_first;
+				return;
+			}
+		}
+		_last = -1;
 	}
 
 	template <value_type ValueType>
 	basic_iterator<ValueType> _erase(basic_iterator<ValueType> it) noexcept(std::is_nothrow_destructible_v<T>) {
 		SHION_ASSERT(it._is_valid_hive_iterator());
 
-		page_riterator         owning_page = page_riterator{std::next(it._current_page_it)};
+		page_t* owning_page = it._current_page;
 
 		owning_page->erase(it._index - owning_page->global_index_of_first);
+		_update_erased_page(owning_page);
 		if (--_size == 0) {
 			_last = -1;
 			return {};
@@ -652,20 +1601,23 @@ private:
 			return it++;
 		}
 
-		while (owning_page != _pages.rend()) {
-			if (auto last = owning_page->find_last(); last >= 0) {
-				_last = last + owning_page->global_index_of_first;
-				return {};
-			}
-			++owning_page;
-		}
-		_last = -1;
+		_update_last(it._index / elements_per_page);
 		return {};
 	}
 
-	ssize_t         _size{0};
-	ssize_t         _last{-1};
-	std::list<detail::hive_page<T>> _pages{};
+	ssize_t                 _size{0};
+	ssize_t                 _last{-1};
+	ssize_t                 _first_free_page_word{0};
+	ssize_t                 _first_hole_word{0};
+	ssize_t                 _page_count{0};
+	uint32                  _next_generation{0};
+	ssize_t                 _max_pooled_pages{std::numeric_limits<ssize_t>::max()};
+	page_allocator          _allocator{};
+	rebound_vector<page_t*> _page_directory{};
+	rebound_vector<page_t*> _pages_by_address{};
+	rebound_vector<uint64>  _free_pages{};
+	rebound_vector<uint64>  _used_pages{};
+	rebound_vector<page_t*> _page_pool{};
 };
 
 }
@@ -0,0 +1,341 @@
+#ifndef SHION_CONTAINERS_SOA_HIVE_H_
+#define SHION_CONTAINERS_SOA_HIVE_H_
+
+#include <shion/common/defines.hpp>
+
+#if !SHION_BUILDING_MODULES
+#include <type_traits>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <functional>
+#include <memory>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <shion/common.hpp>
+#include <shion/containers/hive.hpp>
+#endif
+
+namespace SHION_NAMESPACE {
+
+namespace detail {
+
+template <ssize_t TargetSize, typename... Ts>
+inline constexpr ssize_t soa_hive_page_num_skipfields = hive_page_num_groups(
+	TargetSize,
+	2 * sizeof(ssize_t) + (alignof(Ts) + ...), // Padding between the components
+	sizeof(uint64) + 64 * (sizeof(Ts) + ...),
+	std::max({alignof(Ts)...})
+);
+
+template <ssize_t NumSkipfields, typename... Ts>
+struct soa_hive_page {
+	static inline constexpr ssize_t num_elements = NumSkipfields * 64;
+
+	soa_hive_page() = default;
+	soa_hive_page(soa_hive_page const&) = delete;
+	soa_hive_page& operator=(soa_hive_page const&) = delete;
+
+	~soa_hive_page() {
+		clear();
+	}
+
+	bool has(ssize_t index) const noexcept {
+		return (_skipfields[index >> 6] & (1_u64 << (index & 63))) != 0;
+	}
+
+	bool full() const noexcept {
+		return _size == num_elements;
+	}
+
+	ssize_t find_free() noexcept {
+		// Every skipfield before `_first_free_skipfield` is known to be full
+		for (auto i = _first_free_skipfield; i < NumSkipfields; ++i) {
+			auto count = std::countr_one(_skipfields[i]);
+			if (count < 64) {
+				_first_free_skipfield = i;
+				return (i << 6) | count;
+			}
+		}
+		_first_free_skipfield = NumSkipfields;
+		return -1;
+	}
+
+	/**
+	 * @brief Constructs every component of the element at `index`, or none of them if a constructor throws.
+	 */
+	template <typename... Us>
+	void emplace_at(ssize_t index, Us&&... values) {
+		_emplace_at(std::index_sequence_for<Ts...>{}, index, std::forward<Us>(values)...);
+		_skipfields[index >> 6] |= (1_u64 << (index & 63));
+		++_size;
+	}
+
+	void erase(ssize_t index) noexcept {
+		SHION_ASSERT(has(index));
+
+		_destroy(index, sizeof...(Ts));
+		_skipfields[index >> 6] &= ~(1_u64 << (index & 63));
+		--_size;
+		if ((index >> 6) < _first_free_skipfield) {
+			_first_free_skipfield = index >> 6;
+		}
+	}
+
+	void clear() noexcept {
+		if constexpr (!(std::is_trivially_destructible_v<Ts> && ...)) {
+			for (ssize_t i = 0; i < NumSkipfields; ++i) {
+				for (auto live = _skipfields[i]; live != 0; live &= live - 1) {
+					_destroy((i << 6) | std::countr_zero(live), sizeof...(Ts));
+				}
+			}
+		}
+		std::ranges::fill(_skipfields, 0);
+		_size = 0;
+		_first_free_skipfield = 0;
+	}
+
+	template <size_t I>
+	auto& column() noexcept {
+		return std::get<I>(_columns);
+	}
+
+	/**
+	 * @brief Invokes `fn` with one span per selected component over each contiguous run of live slots.
+	 *
+	 * Runs never cross a skipfield word, so spans hold at most 64 elements, and exactly 64 when the word is full.
+	 */
+	template <size_t... Is, typename Fn>
+	void for_each_segment(std::index_sequence<Is...>, Fn& fn) {
+		static_assert(((sizeof(hive_storage<Ts>) == sizeof(Ts)) && ...), "segments require hive_storage<T> to have the layout of T");
+
+		for (ssize_t i = 0; i < NumSkipfields; ++i) {
+			auto live = _skipfields[i];
+
+			while (live != 0) {
+				auto start = std::countr_zero(live);
+				auto length = std::countr_one(live >> start);
+				auto first = (i << 6) | start;
+
+				std::invoke(fn, std::span{std::addressof(std::get<Is>(_columns)[first].value), static_cast<size_t>(length)}...);
+				live = (start + length == 64) ? 0 : live & (~0_u64 << (start + length));
+			}
+		}
+	}
+
+	ssize_t                                                   _size{};
+	ssize_t                                                   _first_free_skipfield{};
+	uint64                                                    _skipfields[NumSkipfields]{};
+	std::tuple<std::array<hive_storage<Ts>, num_elements>...> _columns{};
+
+private:
+	template <size_t... Is, typename... Us>
+	void _emplace_at(std::index_sequence<Is...>, ssize_t index, Us&&... values) {
+		if constexpr ((std::is_nothrow_constructible_v<Ts, Us> && ...)) {
+			(std::get<Is>(_columns)[index].emplace(std::forward<Us>(values)), ...);
+		} else {
+			size_t constructed = 0;
+
+			try {
+				((std::get<Is>(_columns)[index].emplace(std::forward<Us>(values)), ++constructed), ...);
+			} catch (...) {
+				_destroy(index, constructed);
+				throw;
+			}
+		}
+	}
+
+	void _destroy(ssize_t index, size_t count) noexcept {
+		[&]<size_t... Is>(std::index_sequence<Is...>) {
+			((Is < count ? std::get<Is>(_columns)[index].destroy() : void()), ...);
+		}(std::index_sequence_for<Ts...>{});
+	}
+};
+
+}
+
+/**
+ * @brief Structure-of-arrays variant of `hive`, storing each component of its elements in its own contiguous array.
+ *
+ * All components of an element share a raw index and a slot in the page's skipfield bitmap.
+ * Iterating with `for_each_segment` yields one span per component, so a loop touching one field
+ * only pulls that field through the cache, and a SIMD kernel can process a field across up to 64 slots at a time.
+ *
+ * @tparam PageSize Page size policy, see `hive_page_size`. The target size covers all components of a page.
+ */
+SHION_EXPORT template <typename PageSize, typename... Ts>
+requires (sizeof...(Ts) > 0)
+class basic_soa_hive {
+	using page_t = detail::soa_hive_page<detail::soa_hive_page_num_skipfields<PageSize::target_size, Ts...>, Ts...>;
+
+	static_assert(lossless_cast<ssize_t>(sizeof(page_t)) <= PageSize::target_size || detail::soa_hive_page_num_skipfields<PageSize::target_size, Ts...> == 1, "page overhead was not budgeted for");
+
+public:
+	static inline constexpr auto elements_per_page = page_t::num_elements;
+	static inline constexpr auto num_components = sizeof...(Ts);
+
+	template <size_t I>
+	using component_t = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+	basic_soa_hive() = default;
+	basic_soa_hive(basic_soa_hive const&) = delete;
+	basic_soa_hive(basic_soa_hive&& rhs) noexcept :
+		_size{std::exchange(rhs._size, 0)},
+		_first_free_page{std::exchange(rhs._first_free_page, 0)},
+		_pages{std::exchange(rhs._pages, {})} {
+	}
+	basic_soa_hive& operator=(basic_soa_hive const&) = delete;
+	basic_soa_hive& operator=(basic_soa_hive&& rhs) noexcept {
+		if (this != &rhs) {
+			_size = std::exchange(rhs._size, 0);
+			_first_free_page = std::exchange(rhs._first_free_page, 0);
+			_pages = std::exchange(rhs._pages, {});
+		}
+		return *this;
+	}
+	~basic_soa_hive() = default;
+
+	/**
+	 * @brief Constructs an element from one value per component and returns its raw index.
+	 */
+	template <typename... Us>
+	requires (sizeof...(Us) == sizeof...(Ts) && (std::constructible_from<Ts, Us> && ...))
+	ssize_t emplace(Us&&... values) {
+		page_t* page = nullptr;
+		ssize_t page_idx = _first_free_page;
+
+		// Every page before `_first_free_page` is known to be full
+		while (page_idx < std::ssize(_pages) && _pages[page_idx]->full()) {
+			++page_idx;
+		}
+		if (page_idx == std::ssize(_pages)) {
+			_pages.push_back(std::make_unique<page_t>());
+		}
+		_first_free_page = page_idx;
+		page = _pages[page_idx].get();
+
+		auto idx = page->find_free();
+		SHION_ASSERT(idx >= 0);
+		page->emplace_at(idx, std::forward<Us>(values)...);
+		++_size;
+		return page_idx * elements_per_page + idx;
+	}
+
+	/**
+	 * @brief Destroys the element at raw index `index`. Returns false if there was none.
+	 */
+	bool erase(ssize_t index) noexcept {
+		page_t* page = _get_page(index);
+
+		if (page == nullptr || !page->has(index % elements_per_page)) {
+			return false;
+		}
+		page->erase(index % elements_per_page);
+		--_size;
+		_first_free_page = std::min(_first_free_page, index / elements_per_page);
+		return true;
+	}
+
+	bool contains(ssize_t index) const noexcept {
+		page_t const* page = _get_page(index);
+
+		return page != nullptr && page->has(index % elements_per_page);
+	}
+
+	/**
+	 * @brief Returns component `I` of the element at raw index `index`, which must exist.
+	 */
+	template <size_t I>
+	component_t<I>& get(ssize_t index) noexcept {
+		SHION_ASSERT(contains(index));
+
+		return _pages[index / elements_per_page]->template column<I>()[index % elements_per_page].value;
+	}
+
+	template <size_t I>
+	component_t<I> const& get(ssize_t index) const noexcept {
+		return const_cast<basic_soa_hive*>(this)->template get<I>(index);
+	}
+
+	/**
+	 * @brief Invokes `fn` with one `std::span` per component over each contiguous run of live elements, in raw index order.
+	 *
+	 * With no `Is`, every component is passed in declaration order; otherwise only components `Is...`, in that order.
+	 */
+	template <size_t... Is, typename Fn>
+	void for_each_segment(Fn fn) {
+		if constexpr (sizeof...(Is) == 0) {
+			_for_each_segment(std::index_sequence_for<Ts...>{}, fn);
+		} else {
+			_for_each_segment(std::index_sequence<Is...>{}, fn);
+		}
+	}
+
+	/**
+	 * @brief Invokes `fn` with a reference to each component of every element.
+	 */
+	template <typename Fn>
+	requires (std::invocable<Fn&, Ts&...>)
+	void for_each(Fn fn) {
+		for_each_segment([&fn](std::span<Ts>... segments) {
+			auto length = std::get<0>(std::tie(segments...)).size();
+			for (size_t i = 0; i < length; ++i) {
+				std::invoke(fn, segments[i]...);
+			}
+		});
+	}
+
+	void clear() noexcept {
+		for (auto& page : _pages) {
+			page->clear();
+		}
+		_size = 0;
+		_first_free_page = 0;
+	}
+
+	ssize_t size() const noexcept {
+		return _size;
+	}
+
+	ssize_t capacity() const noexcept {
+		return pages() * elements_per_page;
+	}
+
+	ssize_t pages() const noexcept {
+		return std::ssize(_pages);
+	}
+
+private:
+	page_t* _get_page(ssize_t index) const noexcept {
+		if (index < 0 || index / elements_per_page >= std::ssize(_pages)) {
+			return nullptr;
+		}
+		return _pages[index / elements_per_page].get();
+	}
+
+	template <size_t... Is, typename Fn>
+	void _for_each_segment(std::index_sequence<Is...> components, Fn& fn) {
+		for (auto& page : _pages) {
+			if (page->_size > 0) {
+				page->for_each_segment(components, fn);
+			}
+		}
+	}
+
+	ssize_t                              _size{0};
+	ssize_t                              _first_free_page{0};
+	std::vector<std::unique_ptr<page_t>> _pages{};
+};
+
+/**
+ * @brief `basic_soa_hive` with the default page size.
+ */
+SHION_EXPORT template <typename... Ts>
+using soa_hive = basic_soa_hive<hive_default_page_size, Ts...>;
+
+}
+
+#endif /* SHION_CONTAINERS_SOA_HIVE_H_ */
@@ -3,6 +3,8 @@
 #include <shion/common/defines.hpp>
 
 #if !SHION_BUILDING_MODULES
+#include <shion/meta/type_traits.hpp>
+
 #include "coro.hpp"
 #include "awaitable.hpp"
 
@@ -4,6 +4,7 @@
 
 #if !SHION_BUILDING_MODULES
 #include <shion/common/common.hpp>
+#include <shion/meta/type_traits.hpp>
 #include <shion/coro/coro.hpp>
 #include <shion/coro/awaitable.hpp>
 
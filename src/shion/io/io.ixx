@@ -5,6 +5,7 @@ module;
 
 #if !SHION_IMPORT_STD
 #include <cstring>
+#include <limits>
 #include <cstddef>
 #include <cstdio>
 #include <tuple>
@@ -42,6 +43,7 @@ import :utility;
 import :meta;
 import :monad;
 import :coro;
+import :containers;
 
 using namespace SHION_NAMESPACE ::literals;
 using namespace std::string_view_literals;
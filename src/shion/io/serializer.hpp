@@ -6,10 +6,16 @@
 #if !SHION_BUILDING_MODULES
 #	include <shion/utility/tuple.hpp>
 #	include <shion/common/common.hpp>
+#	include <shion/containers/hive.hpp>
 
 #	include <tuple>
 #	include <ranges>
 #	include <concepts>
+#	include <cstring>
+#	include <limits>
+#	include <bit>
+#	include <span>
+#	include <string_view>
 #endif
 
 namespace SHION_NAMESPACE
@@ -125,6 +131,9 @@ inline namespace io
 SHION_EXPORT template <typename Buffer, typename Tag = void>
 class serializer;
 
+SHION_EXPORT template <typename T, typename Tag = void>
+class serialized_view;
+
 /**
  * @brief Helper for serializing a type into a buffer.
  * The helper can implement `read` and `write`, see the documentation for these member functions.
@@ -662,12 +671,12 @@ private:
 			if constexpr (std::is_trivially_copyable_v<value_t> && requires { proxy_t::trivial; })
 			{
 				std::memcpy(ret.data(), bytes.data(), sizeof(value_t) * n);
-				if constexpr (std::is_scalar_v<value_t> && sizeof(value_t) > 1)
+				if constexpr ((std::integral<value_t> || std::is_enum_v<value_t>) && sizeof(value_t) > 1)
 				{
 					if (endian != std::endian::native)
 					{
 						for (auto& v : ret)
-							v = std::byteswap(v);
+							v = proxy_t{}.byteswap(v);
 					}
 				}
 				bytes = bytes.subspan(sizeof(value_t) * n);
@@ -793,7 +802,7 @@ struct container_reader<T, Tag>
 				if (endian != std::endian::native)
 				{
 					for (size_t i = 0; i < range_size; ++i)
-						value[start + i] = std::byteswap(value[start + i]);
+						value[start + i] = proxy_t{}.byteswap(value[start + i]);
 				}
 			}
 		}
@@ -990,13 +999,13 @@ struct container_writer<T, Tag>
 		if constexpr (std::ranges::contiguous_range<T> && std::is_scalar_v<value_t> && requires { requires proxy_t::trivial; })
 		{
 			std::memcpy(bytes.data() + sz, value.data(), sizeof(value_t) * std::ranges::size(value));
-			if constexpr (sizeof(value_t) > 1 && !std::is_floating_point_v<T>)
+			if constexpr (sizeof(value_t) > 1 && !std::is_floating_point_v<value_t>)
 			{
 				if (endian != std::endian::native)
 				{
-					std::byte* data = bytes.data() + sz;
 					for (size_t i = 0; i < std::ranges::size(value); ++i)
 					{
+						std::byte* data = bytes.data() + sz + i * sizeof(value_t);
 						for (size_t j = 0; j < sizeof(value_t) / 2; ++j)
 						{
 							auto& a = data[j];
@@ -1008,7 +1017,7 @@ struct container_writer<T, Tag>
 					}
 				}
 			}
-			sz += size;
+			sz += size * sizeof(value_t);
 		}
 		else
 		{
@@ -1021,6 +1030,426 @@ struct container_writer<T, Tag>
 	}
 };
 
+/**
+ * @brief Deserializes a contiguous range of scalars as a view of the input bytes, such as `std::span<const T>` or `std::string_view`.
+ *
+ * The range is written like any other, and read back in place without allocating or copying. This requires the bytes to
+ * be in native endianness, unless elements are single bytes or floating point which are never swapped, and to be aligned
+ * for the element type: `viewable` tells whether they are, otherwise `read` fails. Ranges are not padded, so elements
+ * larger than a byte are only aligned if the bytes before them add up to it. The view refers to the input bytes,
+ * which must outlive it.
+ */
+template <typename T, typename Tag>
+struct view_constructor
+{
+private:
+	using value_t = std::remove_const_t<std::ranges::range_value_t<T>>;
+
+	static auto _elements(std::span<const byte> bytes, size_t count) noexcept -> const value_t*
+	{
+#if defined(__cpp_lib_start_lifetime_as) && __cpp_lib_start_lifetime_as >= 202207L
+		return std::start_lifetime_as_array<value_t>(bytes.data(), count);
+#else
+		(void)count;
+		return reinterpret_cast<const value_t*>(bytes.data());
+#endif
+	}
+
+public:
+	/**
+	 * @brief Returns whether the range serialized at the start of `bytes` can be viewed in place.
+	 */
+	static auto viewable(std::span<const byte> bytes, std::endian endian = std::endian::native) noexcept -> bool
+	{
+		auto res = read_compressed_range_size(bytes);
+
+		if (res.idx_out <= 0)
+			return false;
+		if constexpr (sizeof(value_t) > 1 && !std::is_floating_point_v<value_t>)
+		{
+			if (endian != std::endian::native)
+				return false;
+		}
+		return reinterpret_cast<std::uintptr_t>(bytes.data() + res.idx_out) % alignof(value_t) == 0;
+	}
+
+	constexpr auto size(std::span<const byte> bytes, std::endian /* endian */ = std::endian::native) -> ptrdiff_t
+	{
+		auto res = read_compressed_range_size(bytes);
+
+		if (res.idx_out <= 0)
+			return res.idx_out;
+		return res.idx_out + static_cast<ptrdiff_t>(res.range_size * sizeof(value_t));
+	}
+
+	auto read(std::span<const byte> bytes, T& value, std::endian endian = std::endian::native) -> ptrdiff_t
+	{
+		ptrdiff_t sz = size(bytes, endian);
+
+		if (sz <= 0 || sz > static_cast<ptrdiff_t>(bytes.size()) || !viewable(bytes, endian))
+			return 0;
+
+		auto   res = read_compressed_range_size(bytes);
+		size_t count = res.range_size;
+
+		value = T{ _elements(bytes.subspan(res.idx_out), count), count };
+		return sz;
+	}
+
+	auto construct(std::span<const byte>& bytes, std::endian endian = std::endian::native) -> T
+	{
+		T         ret{};
+		ptrdiff_t sz = read(bytes, ret, endian);
+
+		SHION_ASSERT(sz > 0 && "bytes must hold a complete range, in native endianness and aligned for its elements");
+		bytes = bytes.subspan(sz);
+		return ret;
+	}
+};
+
+/**
+ * @brief Serializes `serialized_view`: reading one checks the size of the value and keeps its bytes, writing one copies them.
+ */
+template <typename T, typename Tag>
+struct serialized_view_serializer
+{
+	using view_t = serialized_view<T, Tag>;
+
+	constexpr auto size(std::span<const byte> bytes, std::endian endian = std::endian::native) -> ptrdiff_t
+	{
+		return serializer_helper<T, Tag>{}.size(bytes, endian);
+	}
+
+	constexpr auto read(std::span<const byte> bytes, view_t& value, std::endian endian = std::endian::native) -> ptrdiff_t
+	{
+		ptrdiff_t sz = size(bytes, endian);
+
+		if (sz <= 0 || sz > static_cast<ptrdiff_t>(bytes.size()))
+			return 0;
+		value = view_t{ bytes.first(sz), endian };
+		return sz;
+	}
+
+	constexpr auto construct(std::span<const byte>& bytes, std::endian endian = std::endian::native) -> view_t
+	{
+		view_t    ret;
+		ptrdiff_t sz = read(bytes, ret, endian);
+
+		SHION_ASSERT(sz > 0);
+		bytes = bytes.subspan(sz);
+		return ret;
+	}
+
+	constexpr auto write(std::span<byte> bytes, const view_t& value, std::endian endian = std::endian::native) -> ptrdiff_t
+	{
+		// Converting the bytes to another endianness would require decoding them
+		SHION_ASSERT(endian == value.endian());
+		(void)endian;
+
+		ptrdiff_t sz = value.bytes().size();
+
+		if (static_cast<ptrdiff_t>(bytes.size()) < sz)
+			return sz;
+		std::ranges::copy(value.bytes(), bytes.begin());
+		return sz;
+	}
+};
+
+/**
+ * @brief Serializes a hive page by page, preserving raw indices and handle generations.
+ *
+ * The snapshot is a header (page layout, page count, next generation) followed by, for each page in index order,
+ * its index, skipfields and generations if the hive has handles, then its storage. The page layout is the number of
+ * elements per page and whether generations are stored, a snapshot can only be read into a hive with the same layout.
+ * Trivially copyable elements are stored as the page's raw storage block with free slots zeroed, so a save or restore
+ * is a few memcpys per page; this is only supported in native endianness.
+ * Other elements are written one by one in slot order with their own `serializer_helper`.
+ */
+template <typename T, typename PageSize, typename Allocator, bool Handles, typename Tag>
+struct hive_serializer<hive<T, PageSize, Allocator, Handles>, Tag>
+{
+private:
+	using hive_t = hive<T, PageSize, Allocator, Handles>;
+	using page_t = typename hive_t::page_t;
+	using proxy_t = serializer_helper<T, Tag>;
+
+	static inline constexpr bool block = std::is_trivially_copyable_v<T>;
+	static inline constexpr ssize_t num_skipfields = hive_t::elements_per_page / 64;
+	static inline constexpr uint64 layout = static_cast<uint64>(hive_t::elements_per_page) << 1 | uint64{Handles};
+	static inline constexpr ptrdiff_t header_size = 3 * sizeof(uint64);
+	static inline constexpr ptrdiff_t page_header_size = sizeof(uint64) * (1 + num_skipfields) + (Handles ? sizeof(uint32) * hive_t::elements_per_page : 0);
+	static inline constexpr ptrdiff_t block_size = sizeof(page_t::data);
+
+	template <typename U>
+	static auto _write_words(std::span<std::byte> bytes, std::span<U const> words, std::endian endian) noexcept -> ptrdiff_t
+	{
+		if (endian == std::endian::native)
+		{
+			std::memcpy(bytes.data(), words.data(), words.size_bytes());
+		}
+		else
+		{
+			for (size_t i = 0; i < words.size(); ++i)
+				scalar_serializer<U>{}.write(bytes.subspan(i * sizeof(U)), words[i], endian);
+		}
+		return words.size_bytes();
+	}
+
+	template <typename U>
+	static auto _read_words(std::span<std::byte const> bytes, std::span<U> words, std::endian endian) noexcept -> ptrdiff_t
+	{
+		std::memcpy(words.data(), bytes.data(), words.size_bytes());
+		if (endian != std::endian::native)
+		{
+			for (U& word : words)
+				word = std::byteswap(word);
+		}
+		return words.size_bytes();
+	}
+
+	/**
+	 * @brief Zeroes the free slots of a block written from `skipfields`, which hold whatever was last in memory.
+	 */
+	static void _zero_free_slots(std::byte* block, uint64 const (&skipfields)[num_skipfields]) noexcept
+	{
+		for (ssize_t i = 0; i < num_skipfields; ++i)
+		{
+			for (auto free = ~skipfields[i]; free != 0;)
+			{
+				auto start = std::countr_zero(free);
+				auto length = std::countr_one(free >> start);
+
+				std::memset(block + ((i << 6) | start) * sizeof(T), 0, length * sizeof(T));
+				free = (start + length == 64) ? 0 : free & (~0_u64 << (start + length));
+			}
+		}
+	}
+
+	template <typename Fn>
+	static void _for_each_live(uint64 const (&skipfields)[num_skipfields], Fn&& fn)
+	{
+		for (ssize_t i = 0; i < num_skipfields; ++i)
+		{
+			for (auto live = skipfields[i]; live != 0; live &= live - 1)
+				fn((i << 6) | std::countr_zero(live));
+		}
+	}
+
+	static auto _page_size(page_t const& page, std::endian endian) -> ptrdiff_t
+	{
+		if constexpr (block)
+		{
+			return page_header_size + block_size;
+		}
+		else
+		{
+			ptrdiff_t sz = page_header_size;
+			_for_each_live(page._skipfields, [&](ssize_t idx) {
+				sz += proxy_t{}.write({}, page.data[idx].value, endian);
+			});
+			return sz;
+		}
+	}
+
+	static auto _write_page(std::span<std::byte> bytes, page_t const& page, std::endian endian) -> ptrdiff_t
+	{
+		ptrdiff_t sz = scalar_serializer<uint64>{}.write(bytes, static_cast<uint64>(page.global_index_of_first / hive_t::elements_per_page), endian);
+
+		sz += _write_words(bytes.subspan(sz), std::span<uint64 const>{page._skipfields}, endian);
+		if constexpr (Handles)
+			sz += _write_words(bytes.subspan(sz), std::span<uint32 const>{page._generations}, endian);
+		if constexpr (block)
+		{
+			std::memcpy(bytes.data() + sz, static_cast<void const*>(page.data.data()), block_size);
+			_zero_free_slots(bytes.data() + sz, page._skipfields);
+			sz += block_size;
+		}
+		else
+		{
+			_for_each_live(page._skipfields, [&](ssize_t idx) {
+				sz += proxy_t{}.write(bytes.subspan(sz), page.data[idx].value, endian);
+			});
+		}
+		return sz;
+	}
+
+	/**
+	 * @brief Reads a page, which must come after `next_page_idx` and before `end_page_idx`. Returns 0 if it does not.
+	 */
+	static auto _read_page(std::span<std::byte const> bytes, hive_t& value, std::endian endian, uint64& next_page_idx, uint64 end_page_idx) -> ptrdiff_t
+	{
+		uint64 page_idx = 0;
+		uint64 skipfields[num_skipfields];
+		ptrdiff_t sz = scalar_serializer<uint64>{}.read(bytes, page_idx, endian);
+
+		sz += _read_words(bytes.subspan(sz), std::span<uint64>{skipfields}, endian);
+		if (page_idx < next_page_idx || page_idx >= end_page_idx)
+			return 0;
+		next_page_idx = page_idx + 1;
+
+		page_t* page = value._make_page(static_cast<ssize_t>(page_idx));
+		// Also runs if an element constructor throws, the page then holds the elements read so far
+		and_then commit = [&]() noexcept {
+			value._size += page->size();
+			if (page->size() == 0)
+				value._retire_page(page);
+			else
+				value._update_filled_page(page);
+		};
+
+		if constexpr (Handles)
+			sz += _read_words(bytes.subspan(sz), std::span<uint32>{page->_generations}, endian);
+		if constexpr (block)
+		{
+			std::memcpy(static_cast<void*>(page->data.data()), bytes.data() + sz, block_size);
+			std::ranges::copy(skipfields, page->_skipfields);
+			for (uint64 word : skipfields)
+				page->_size += std::popcount(word);
+			sz += block_size;
+		}
+		else
+		{
+			auto remaining = bytes.subspan(sz);
+
+			_for_each_live(skipfields, [&](ssize_t idx) {
+				page->data[idx].emplace(proxy_t{}.construct(remaining, endian));
+				page->_skipfields[idx >> 6] |= (1_u64 << (idx & 63));
+				++page->_size;
+			});
+			sz = bytes.size() - remaining.size();
+		}
+		return sz;
+	}
+
+public:
+	static inline constexpr bool trivial = false;
+
+	constexpr auto construct(std::span<const std::byte>& bytes, std::endian endian = std::endian::native) -> hive_t
+	{
+		hive_t ret;
+		auto   sz = read(bytes, ret, endian);
+
+		SHION_ASSERT(sz > 0);
+		bytes = bytes.subspan(sz);
+		return ret;
+	}
+
+	/**
+	 * @brief Evaluates the size of a snapshot. Returns 0 if it was taken from a hive with a different page size.
+	 */
+	constexpr auto size(std::span<const std::byte> bytes, std::endian endian = std::endian::native) -> ptrdiff_t
+	{
+		if constexpr (block)
+		{
+			if (endian != std::endian::native)
+				return 0;
+		}
+		if (std::ssize(bytes) < header_size)
+			return -header_size;
+
+		uint64 header[3];
+		_read_words(bytes, std::span<uint64>{header}, endian);
+		if (header[0] != layout)
+			return 0;
+		if constexpr (block)
+		{
+			// Checked first so that a corrupt page count cannot overflow
+			if (header[1] > static_cast<uint64>(std::numeric_limits<ptrdiff_t>::max() - header_size) / (page_header_size + block_size))
+				return 0;
+			return header_size + static_cast<ptrdiff_t>(header[1]) * (page_header_size + block_size);
+		}
+		else
+		{
+			ptrdiff_t sz = header_size;
+			uint64    skipfields[num_skipfields];
+
+			for (uint64 i = 0; i < header[1]; ++i)
+			{
+				if (std::ssize(bytes) < sz + page_header_size)
+					return -(sz + page_header_size);
+				_read_words(bytes.subspan(sz + sizeof(uint64)), std::span<uint64>{skipfields}, endian);
+				sz += page_header_size;
+
+				bool incomplete = false;
+				_for_each_live(skipfields, [&](ssize_t) {
+					if (incomplete)
+						return;
+					ptrdiff_t element_size = proxy_t{}.size(bytes.subspan(std::min<ptrdiff_t>(sz, std::ssize(bytes))), endian);
+					incomplete = element_size <= 0;
+					sz += element_size * bool_to_sign(element_size > 0);
+				});
+				if (incomplete)
+					return -sz;
+			}
+			return sz;
+		}
+	}
+
+	/**
+	 * @brief Replaces the contents of `value` with the snapshot in `bytes`, at the same raw indices.
+	 *
+	 * Page indices must be increasing, and the page directory may not grow past the page count plus the snapshot's size
+	 * in bytes: a corrupt index is rejected instead of making the hive allocate a directory of any size.
+	 *
+	 * @return Returns the amount of bytes read, or 0 if the snapshot is incompatible or malformed.
+	 */
+	constexpr auto read(std::span<const std::byte> bytes, hive_t& value, std::endian endian = std::endian::native) -> ptrdiff_t
+	{
+		if (auto sz = size(bytes, endian); sz <= 0 || sz > std::ssize(bytes))
+			return 0;
+
+		uint64 header[3];
+		ptrdiff_t sz = _read_words(bytes, std::span<uint64>{header}, endian);
+
+		uint64 next_page_idx = 0;
+		uint64 end_page_idx = header[1] + bytes.size();
+
+		value.clear();
+		for (uint64 i = 0; i < header[1]; ++i)
+		{
+			ptrdiff_t page_size = _read_page(bytes.subspan(sz), value, endian, next_page_idx, end_page_idx);
+
+			if (page_size == 0)
+			{
+				value.clear();
+				return 0;
+			}
+			sz += page_size;
+		}
+		value._next_generation = std::max(value._next_generation, static_cast<uint32>(header[2]));
+		return sz;
+	}
+
+	constexpr auto write(std::span<std::byte> bytes, const hive_t& value, std::endian endian = std::endian::native) -> ptrdiff_t
+	{
+		if constexpr (block)
+		{
+			if (endian != std::endian::native)
+				return 0;
+		}
+
+		ptrdiff_t sz = header_size;
+		for (page_t const* page : value._page_directory)
+		{
+			if (page != nullptr)
+				sz += _page_size(*page, endian);
+		}
+		if (std::ssize(bytes) < sz)
+			return sz;
+
+		uint64 const header[3] = { layout, static_cast<uint64>(value._page_count), value._next_generation };
+		ptrdiff_t    written = _write_words(bytes, std::span<uint64 const>{header}, endian);
+
+		for (page_t const* page : value._page_directory)
+		{
+			if (page != nullptr)
+				written += _write_page(bytes.subspan(written), *page, endian);
+		}
+		SHION_ASSERT(written == sz);
+		return sz;
+	}
+};
+
 }
 
 inline namespace io
@@ -1038,6 +1467,102 @@ struct serializer_helper<T, Tag> : detail::serializer::container_constructor<T,
 {
 };
 
+template <typename T, typename PageSize, typename Allocator, bool Handles, typename Tag>
+	requires (std::is_trivially_copyable_v<T> || (serializable<T> && deserialize_constructible<T>))
+struct serializer_helper<hive<T, PageSize, Allocator, Handles>, Tag> : detail::serializer::hive_serializer<hive<T, PageSize, Allocator, Handles>, Tag>
+{
+};
+
+template <typename T, typename Tag>
+	requires (std::is_scalar_v<T> && !std::is_pointer_v<T>)
+struct serializer_helper<std::span<const T>, Tag> : detail::serializer::view_constructor<std::span<const T>, Tag>, detail::serializer::container_writer<std::span<const T>, Tag>
+{
+};
+
+template <typename Char, typename Traits, typename Tag>
+struct serializer_helper<std::basic_string_view<Char, Traits>, Tag> : detail::serializer::view_constructor<std::basic_string_view<Char, Traits>, Tag>, detail::serializer::container_writer<std::basic_string_view<Char, Traits>, Tag>
+{
+};
+
+template <typename T, typename Tag>
+struct serializer_helper<serialized_view<T, Tag>, Tag> : detail::serializer::serialized_view_serializer<T, Tag>
+{
+};
+
+/**
+ * @brief View of a serialized tuple-like `T`, which decodes its fields one at a time as they are accessed.
+ *
+ * Fields that are views themselves, such as `std::span<const T>`, `std::string_view` or another `serialized_view`,
+ * refer to the serialized bytes instead of copying them, so a large record can be read without allocating.
+ * Accessing a field skips over the fields before it, which only reads their sizes.
+ * The bytes must outlive the view, and any field referring to them.
+ */
+SHION_EXPORT template <typename T, typename Tag>
+class serialized_view
+{
+public:
+	template <size_t N>
+	using element_t = std::remove_cv_t<std::tuple_element_t<N, T>>;
+
+	constexpr serialized_view() = default;
+
+	constexpr explicit serialized_view(std::span<const byte> bytes, std::endian endian = std::endian::native) noexcept :
+		_bytes{bytes},
+		_endian{endian}
+	{}
+
+	/**
+	 * @brief Decodes field `N`.
+	 */
+	template <size_t N>
+	constexpr auto get() const -> element_t<N>
+	{
+		auto bytes = _bytes.subspan(offset<N>());
+		return serializer_helper<element_t<N>, Tag>{}.construct(bytes, _endian);
+	}
+
+	/**
+	 * @brief Returns the position of field `N` in the bytes.
+	 */
+	template <size_t N>
+	constexpr auto offset() const -> size_t
+	{
+		size_t off = 0;
+		auto skip = [this, &off]<size_t I>() {
+			ptrdiff_t sz = serializer_helper<element_t<I>, Tag>{}.size(_bytes.subspan(off), _endian);
+			SHION_ASSERT(sz > 0 && off + sz <= _bytes.size());
+			off += sz;
+		};
+		[&skip]<size_t... Is>(std::index_sequence<Is...>) {
+			(skip.template operator()<Is>(), ...);
+		}(std::make_index_sequence<N>{});
+		return off;
+	}
+
+	/**
+	 * @brief Decodes every field.
+	 */
+	constexpr auto materialize() const -> T
+	{
+		auto bytes = _bytes;
+		return serializer_helper<T, Tag>{}.construct(bytes, _endian);
+	}
+
+	constexpr auto bytes() const noexcept -> std::span<const byte>
+	{
+		return _bytes;
+	}
+
+	constexpr auto endian() const noexcept -> std::endian
+	{
+		return _endian;
+	}
+
+private:
+	std::span<const byte> _bytes{};
+	std::endian           _endian{std::endian::native};
+};
+
 }
 
 namespace detail
@@ -13,3 +13,4 @@ export import :math;
 export import :containers;
 export import :io;
 export import :coro;
+export import :cache;
@@ -0,0 +1,952 @@
+module;
+
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../tests.hpp"
+
+module shion.tests;
+
+#if SHION_MODULES
+import shion;
+#endif
+
+namespace shion::tests {
+
+namespace {
+
+// Sends every key to one of 7 hashes, so that lookups must walk long probe sequences
+struct colliding_hash {
+	size_t operator()(int i) const noexcept {
+		return static_cast<size_t>(i % 7) * 0x1234567;
+	}
+};
+
+struct string_hash {
+	using is_transparent = void;
+
+	size_t operator()(std::string_view s) const noexcept {
+		return std::hash<std::string_view>{}(s);
+	}
+};
+
+// Key type only constructible from a string_view, counting how often that happens
+struct converted_key {
+	inline static int conversions = 0;
+
+	converted_key() = default;
+
+	converted_key(std::string_view v) : s{v} {
+		++conversions;
+	}
+
+	bool operator==(converted_key const&) const = default;
+
+	std::string s;
+};
+
+struct converted_key_hash {
+	size_t operator()(converted_key const& k) const noexcept {
+		return std::hash<std::string>{}(k.s);
+	}
+};
+
+// Suspends until resumed by hand
+struct manual_event {
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> h) noexcept {
+		handle = h;
+	}
+
+	void await_resume() const noexcept {}
+
+	std::coroutine_handle<> handle;
+};
+
+}
+
+bool cache_test_shards(test& self) {
+	using cache_t = cache<std::string, int, std::hash<std::string>, std::equal_to<>>;
+
+	for (size_t shards : {1, 3, 16}) {
+		cache_t c{shards};
+		std::atomic<bool> ok{true};
+		std::vector<std::thread> threads;
+
+		TEST_ASSERT(self, c.shards() == std::bit_ceil(shards));
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&] {
+				for (int i = 0; i < 2000; ++i) {
+					auto key = std::to_string(i);
+					auto [inserted, _] = c.try_emplace(key, i);
+					auto found = c.find(key);
+					auto const_found = std::as_const(c).find(key);
+
+					if (*inserted != i || !found || *found != i || !const_found || *const_found != i)
+						ok = false;
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		TEST_ASSERT(self, ok);
+		for (int i = 0; i < 2000; ++i) {
+			auto found = c.find(std::to_string(i));
+
+			TEST_ASSERT(self, found && *found == i);
+		}
+	}
+	return true;
+}
+
+bool cache_test_index(test& self) {
+	cache<int, int, colliding_hash, std::equal_to<>> c;
+
+	for (int i = 0; i < 3000; ++i) {
+		auto [value, inserted] = c.try_emplace(i, i * 2);
+		TEST_ASSERT(self, inserted && *value == i * 2);
+	}
+	for (int i = 0; i < 3000; ++i) {
+		auto [value, inserted] = c.try_emplace(i, -1);
+		TEST_ASSERT(self, !inserted && *value == i * 2);
+	}
+	for (int i = 0; i < 3000; ++i) {
+		auto value = c.find(i);
+		TEST_ASSERT(self, value && *value == i * 2);
+	}
+	TEST_ASSERT(self, !c.find(5000));
+	TEST_ASSERT(self, c.size() == 3000);
+
+	// operator[] default-constructs missing values
+	auto value = c[3001];
+	TEST_ASSERT(self, value && *value == 0);
+	TEST_ASSERT(self, c.size() == 3001);
+	return true;
+}
+
+template <typename Eviction>
+bool cache_eviction_test(test& self) {
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>, Eviction>;
+
+	{
+		cache_t c{cache_options{.capacity = 100}};
+
+		for (int i = 0; i < 1000; ++i)
+			c.try_emplace(i, std::to_string(i));
+		TEST_ASSERT(self, c.size() <= 100);
+		TEST_ASSERT(self, c.size() >= 90);
+		for (int i = 0; i < 1000; ++i) {
+			auto value = c.find(i);
+			TEST_ASSERT(self, !value || *value == std::to_string(i));
+		}
+	}
+	{
+		// Held entries are never evicted, the cache goes over capacity instead
+		cache_t c{cache_options{.capacity = 100}};
+		std::vector<cached_resource<std::string>> held;
+
+		for (int i = 0; i < 150; ++i)
+			held.push_back(c.try_emplace(i, std::to_string(i)).first);
+		for (int i = 150; i < 1000; ++i)
+			c.try_emplace(i, std::to_string(i));
+		for (int i = 0; i < 150; ++i)
+			TEST_ASSERT(self, c.find(i));
+		TEST_ASSERT(self, c.size() >= 150);
+		held.clear();
+		for (int i = 0; i < 200; ++i)
+			c.try_emplace(10000 + i, "cold");
+		TEST_ASSERT(self, c.size() <= 100);
+	}
+	{
+		// A key looked up between every insert survives
+		cache_t c{cache_options{.capacity = 64}};
+
+		c.try_emplace(-1, "hot");
+		for (int i = 0; i < 5000; ++i) {
+			c.find(-1);
+			c.try_emplace(i, "cold");
+		}
+		TEST_ASSERT(self, c.find(-1));
+	}
+	{
+		cache_t c{cache_options{.capacity = 1000}, [](int const&, std::string const& value) { return value.size(); }};
+
+		for (int i = 0; i < 1000; ++i)
+			c.try_emplace(i, std::string(50, 'a'));
+		TEST_ASSERT(self, c.size() <= 20);
+	}
+	{
+		cache_t c{cache_options{.shards = 8, .capacity = 512}};
+		std::atomic<bool> ok{true};
+		std::vector<std::thread> threads;
+
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&, t] {
+				for (int i = 0; i < 20000; ++i) {
+					int key = (i * 7 + t) % 2000;
+
+					if (auto value = c.find(key); !value)
+						c.try_emplace(key, std::to_string(key));
+					else if (*value != std::to_string(key))
+						ok = false;
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		TEST_ASSERT(self, ok);
+		TEST_ASSERT(self, c.size() <= 512);
+	}
+	return true;
+}
+
+bool cache_test_eviction(test& self) {
+	if (!cache_eviction_test<lru_eviction>(self))
+		return false;
+
+	if (!cache_eviction_test<clock_eviction>(self))
+		return false;
+
+	if (!cache_eviction_test<tiny_lfu_eviction>(self))
+		return false;
+
+	return true;
+}
+
+bool cache_test_expiry(test& self) {
+	using namespace std::chrono_literals;
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>>;
+
+	{
+		cache_t c{cache_options{.shards = 2, .time_to_live = 50ms}};
+
+		TEST_ASSERT(self, c.try_emplace(1, "a").second);
+		auto held = c.find(1);
+		TEST_ASSERT(self, held);
+		std::this_thread::sleep_for(100ms);
+
+		// Expired entries are treated as missing, but held values stay alive
+		TEST_ASSERT(self, !c.find(1));
+		TEST_ASSERT(self, *held == "a");
+		auto [value, inserted] = c.try_emplace(1, "b");
+		TEST_ASSERT(self, inserted && *value == "b");
+		TEST_ASSERT(self, *held == "a");
+		TEST_ASSERT(self, c.size() == 1);
+		held = {};
+		TEST_ASSERT(self, c.sweep(1000) == 0);
+
+		c.try_emplace_for(1h, 2, "long");
+		c.try_emplace_until(std::chrono::steady_clock::now() - 1s, 3, "past");
+		TEST_ASSERT(self, !c.find(3));
+		std::this_thread::sleep_for(100ms);
+		TEST_ASSERT(self, c.size() == 3);
+
+		// Sweeping is incremental, but eventually removes every expired entry
+		size_t removed = 0;
+		for (int i = 0; i < 100; ++i)
+			removed += c.sweep(10);
+		TEST_ASSERT(self, removed == 2);
+		TEST_ASSERT(self, c.size() == 1);
+		TEST_ASSERT(self, *c.find(2) == "long");
+	}
+	{
+		cache_t c{cache_options{.time_to_live = 100ms, .expire_after_access = true}};
+
+		c.try_emplace(1, "x");
+		for (int i = 0; i < 10; ++i) {
+			std::this_thread::sleep_for(20ms);
+			TEST_ASSERT(self, c.find(1));
+		}
+		std::this_thread::sleep_for(200ms);
+		TEST_ASSERT(self, !c.find(1));
+	}
+	{
+		cache_t c{cache_options{.shards = 4, .capacity = 64, .time_to_live = 5ms}};
+		std::atomic<bool> ok{true};
+		std::atomic<bool> stop{false};
+		std::thread sweeper{[&] {
+			while (!stop)
+				c.sweep(100);
+		}};
+		std::vector<std::thread> threads;
+
+		for (int t = 0; t < 4; ++t) {
+			threads.emplace_back([&, t] {
+				for (int i = 0; i < 20000; ++i) {
+					int key = (i * 7 + t) % 500;
+					auto value = c.find(key);
+
+					if (!value)
+						value = c.try_emplace(key, std::to_string(key)).first;
+					if (*value != std::to_string(key))
+						ok = false;
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		stop = true;
+		sweeper.join();
+		TEST_ASSERT(self, ok);
+		std::this_thread::sleep_for(10ms);
+		c.sweep(1'000'000);
+		TEST_ASSERT(self, c.size() == 0);
+	}
+	return true;
+}
+
+bool cache_test_load(test& self) {
+	using namespace std::chrono_literals;
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>>;
+
+	{
+		cache_t c{4};
+		std::atomic<int> calls{0};
+		std::vector<std::string> results(8);
+		std::vector<std::thread> threads;
+
+		// Concurrent loads of one key run the loader once
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&, t] {
+				results[t] = *c.get_or_load(42, [&] {
+					++calls;
+					std::this_thread::sleep_for(50ms);
+					return std::string{"v42"};
+				});
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		TEST_ASSERT(self, calls == 1);
+		TEST_ASSERT(self, std::ranges::all_of(results, [](std::string const& r) { return r == "v42"; }));
+		TEST_ASSERT(self, *c.find(42) == "v42");
+
+		// A throwing loader fails every waiter and inserts nothing
+		std::atomic<int> thrown{0};
+		threads.clear();
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&] {
+				try {
+					c.get_or_load(7, []() -> std::string {
+						std::this_thread::sleep_for(50ms);
+						throw std::runtime_error("load failed");
+					});
+				} catch (std::runtime_error const&) {
+					++thrown;
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		TEST_ASSERT(self, thrown == 8);
+		TEST_ASSERT(self, !c.find(7));
+		TEST_ASSERT(self, *c.get_or_load(7, [] { return std::string{"ok"}; }) == "ok");
+
+		// Loads do not hold the shard lock
+		std::thread slow{[&] {
+			c.get_or_load(100, [] {
+				std::this_thread::sleep_for(300ms);
+				return std::string{"slow"};
+			});
+		}};
+		std::this_thread::sleep_for(20ms);
+		auto start = std::chrono::steady_clock::now();
+		c.try_emplace(101, "fast");
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		slow.join();
+		TEST_ASSERT(self, elapsed < 150ms);
+	}
+	{
+		cache_t c{1};
+		manual_event event;
+		std::string first;
+		std::string second;
+		auto waiter = [](cache_t& c, std::string& result) -> task<void> {
+			result = *co_await c.get_or_load_async(5, [] { return std::string{"duplicate"}; });
+		};
+		auto owner = c.get_or_load_async(5, [&event]() -> task<std::string> {
+			co_await event;
+			co_return "async";
+		});
+		auto first_waiter = waiter(c, first);
+		auto second_waiter = waiter(c, second);
+
+		TEST_ASSERT(self, first.empty() && second.empty() && !c.find(5));
+		event.handle.resume();
+		TEST_ASSERT(self, first == "async" && second == "async" && *c.find(5) == "async");
+
+		bool caught = false;
+		auto thrower = [](cache_t& c, bool& caught) -> task<void> {
+			try {
+				co_await c.get_or_load_async(6, []() -> std::string { throw std::runtime_error("load failed"); });
+			} catch (std::runtime_error const&) {
+				caught = true;
+			}
+		};
+		auto failed_load = thrower(c, caught);
+		TEST_ASSERT(self, caught && !c.find(6));
+	}
+	return true;
+}
+
+bool cache_test_stats(test& self) {
+	using namespace std::chrono_literals;
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>>;
+
+	{
+		cache_t c{cache_options{.shards = 4, .capacity = 8, .record_stats = true}};
+
+		for (int i = 0; i < 16; ++i)
+			c.try_emplace(i, "x");
+		auto held = c.find(15);
+		auto held_again = c.find(15);
+		c.find(15);
+		c.find(1000);
+		c.try_emplace(15, "y");
+		try {
+			c.get_or_load(500, []() -> std::string { throw std::runtime_error("load failed"); });
+		} catch (std::runtime_error const&) {
+		}
+		c.get_or_load(501, [] {
+			std::this_thread::sleep_for(3ms);
+			return std::string{"loaded"};
+		});
+
+		cache_stats stats = c.stats();
+		TEST_ASSERT(self, stats.inserts == 17);
+		TEST_ASSERT(self, stats.hits == 4);
+		TEST_ASSERT(self, stats.misses == 16 + 1 + 2);
+		TEST_ASSERT(self, stats.load_failures == 1);
+		TEST_ASSERT(self, stats.evictions == stats.inserts - stats.entries);
+		TEST_ASSERT(self, stats.hit_ratio() == 4.0 / 23.0);
+
+		// 3 ms falls in [2048, 4096) microseconds, or later buckets if the thread overslept
+		TEST_ASSERT(self, std::reduce(stats.load_latency.begin(), stats.load_latency.end()) == 1);
+		TEST_ASSERT(self, std::reduce(stats.load_latency.begin(), stats.load_latency.begin() + 11) == 0);
+
+		TEST_ASSERT(self, std::reduce(stats.references.begin(), stats.references.end()) == stats.entries);
+		TEST_ASSERT(self, stats.references[0] < stats.entries);
+	}
+	{
+		// Counters are only kept when asked for
+		cache_t c{cache_options{.shards = 1}};
+
+		c.try_emplace(1, "a");
+		c.find(1);
+		cache_stats stats = c.stats();
+		TEST_ASSERT(self, stats.hits == 0 && stats.inserts == 0 && stats.entries == 1);
+	}
+	{
+		cache_t c{cache_options{.shards = 2, .record_stats = true}};
+		std::vector<std::thread> threads;
+
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&] {
+				for (int i = 0; i < 20000; ++i) {
+					if (!c.find(i % 100))
+						c.try_emplace(i % 100, "v");
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		cache_stats stats = c.stats();
+		TEST_ASSERT(self, stats.inserts == 100);
+		TEST_ASSERT(self, stats.hits + stats.misses >= 8 * 20000);
+	}
+	return true;
+}
+
+bool cache_test_lock_free_reads(test& self) {
+	using namespace std::chrono_literals;
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>, clock_eviction>;
+
+	// Readers racing inserts, evictions and sweeps must always see the value of the key they asked for
+	for (size_t capacity : {0, 256}) {
+		cache_t c{cache_options{.shards = 4, .capacity = capacity, .time_to_live = capacity != 0 ? 0ms : 2ms, .lock_free_reads = true}};
+		std::atomic<bool> ok{true};
+		std::atomic<bool> stop{false};
+		std::vector<std::thread> readers;
+		std::vector<std::thread> writers;
+
+		for (unsigned t = 0; t < 4; ++t) {
+			readers.emplace_back([&, t] {
+				unsigned x = t * 7919 + 1;
+
+				while (!stop) {
+					x = x * 1103515245 + 12345;
+					int key = static_cast<int>((x >> 8) % 2000);
+
+					if (auto value = c.find(key); value && *value != std::to_string(key))
+						ok = false;
+				}
+			});
+		}
+		std::thread sweeper{[&] {
+			while (!stop) {
+				c.sweep(256);
+				std::this_thread::yield();
+			}
+		}};
+		for (int w = 0; w < 2; ++w) {
+			writers.emplace_back([&, w] {
+				for (int i = 0; i < 20000; ++i) {
+					int key = (i * 13 + w * 1000) % 2000;
+
+					if (*c.try_emplace(key, std::to_string(key)).first != std::to_string(key))
+						ok = false;
+				}
+			});
+		}
+		for (auto& thread : writers)
+			thread.join();
+		stop = true;
+		for (auto& thread : readers)
+			thread.join();
+		sweeper.join();
+		TEST_ASSERT(self, ok);
+		TEST_ASSERT(self, capacity == 0 || c.size() <= capacity + c.shards());
+	}
+
+	// Lookups cannot record accesses for an eviction policy that does not allow them concurrently
+	using lru_cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>, lru_eviction>;
+	bool thrown = false;
+	try {
+		lru_cache_t c{cache_options{.capacity = 16, .lock_free_reads = true}};
+	} catch (const std::invalid_argument&) {
+		thrown = true;
+	}
+	TEST_ASSERT(self, thrown);
+	lru_cache_t unbounded{cache_options{.lock_free_reads = true}};
+	TEST_ASSERT(self, unbounded.try_emplace(1, "1").second);
+	return true;
+}
+
+bool cache_bench_find(test& self) {
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>, clock_eviction>;
+	constexpr int iterations = 500'000;
+
+	for (bool lock_free : {false, true}) {
+		cache_t c{cache_options{.shards = 16, .lock_free_reads = lock_free}};
+
+		for (int i = 0; i < 10000; ++i)
+			c.try_emplace(i, "v");
+		for (unsigned num_threads : {1u, 2u, 4u}) {
+			std::atomic<size_t> found{0};
+			std::vector<std::thread> threads;
+			auto start = std::chrono::steady_clock::now();
+
+			for (unsigned t = 0; t < num_threads; ++t) {
+				threads.emplace_back([&] {
+					size_t n = 0;
+
+					for (int i = 0; i < iterations; ++i)
+						n += static_cast<bool>(c.find((i * 7) % 10000));
+					found += n;
+				});
+			}
+			for (auto& thread : threads)
+				thread.join();
+			std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+			TEST_ASSERT(self, found == num_threads * size_t{iterations});
+			g_logger->info("  {} reads, {} threads: {:.1f} Mfind/s", lock_free ? "lock-free" : "locked", num_threads, num_threads * iterations / elapsed.count());
+		}
+	}
+	return true;
+}
+
+bool cache_test_batch_find(test& self) {
+	{
+		cache<std::string, int, string_hash, std::equal_to<>> c{8};
+
+		for (int i = 0; i < 1000; ++i)
+			c.try_emplace(std::to_string(i), i);
+		TEST_ASSERT(self, *c.find(std::string_view{"42"}) == 42);
+
+		std::vector<std::string_view> keys{"1", "999", "missing", "500", "1"};
+		auto found = c.find_many(std::span{keys});
+		TEST_ASSERT(self, found.size() == 5);
+		TEST_ASSERT(self, *found[0] == 1 && *found[1] == 999 && !found[2] && *found[3] == 500 && *found[4] == 1);
+
+		std::vector<size_t> hashes;
+		for (std::string_view key : keys)
+			hashes.push_back(c.hash(key));
+		auto prehashed = c.find_many(std::span<std::string_view const>{keys}, hashes);
+		TEST_ASSERT(self, *prehashed[1] == 999 && !prehashed[2] && *prehashed[3] == 500);
+		TEST_ASSERT(self, c.find_many(std::span<std::string const>{}).empty());
+	}
+	{
+		// Without a transparent hasher, lookups convert the key once
+		cache<converted_key, int, converted_key_hash, std::equal_to<converted_key>> c{4};
+
+		c.try_emplace(converted_key{"a"}, 1);
+		converted_key::conversions = 0;
+		TEST_ASSERT(self, *c.find(std::string_view{"a"}) == 1);
+		TEST_ASSERT(self, converted_key::conversions == 1);
+
+		std::vector<std::string_view> keys{"a", "b"};
+		auto found = c.find_many(std::span{keys});
+		TEST_ASSERT(self, *found[0] == 1 && !found[1]);
+	}
+	return true;
+}
+
+bool cache_bench_batch_find(test& self) {
+	constexpr int num_entries = 1 << 18;
+	constexpr int repetitions = 20;
+
+	for (bool lock_free : {false, true}) {
+		cache<int, int, std::hash<int>, std::equal_to<>, clock_eviction> c{cache_options{.shards = 16, .lock_free_reads = lock_free}};
+		std::vector<int> keys(4096);
+		unsigned x = 1;
+		std::chrono::duration<double, std::micro> loop_time{0};
+		std::chrono::duration<double, std::micro> batch_time{0};
+
+		for (int i = 0; i < num_entries; ++i)
+			c.try_emplace(i, i);
+		for (int rep = 0; rep < repetitions; ++rep) {
+			for (int& key : keys) {
+				x = x * 1103515245 + 12345;
+				key = static_cast<int>((x >> 4) % num_entries);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			size_t loop_sum = 0;
+			for (int key : keys)
+				loop_sum += static_cast<size_t>(*c.find(key));
+			auto middle = std::chrono::steady_clock::now();
+			auto found = c.find_many(std::span<int const>{keys});
+			auto end = std::chrono::steady_clock::now();
+
+			size_t batch_sum = 0;
+			for (auto const& value : found)
+				batch_sum += static_cast<size_t>(*value);
+			TEST_ASSERT(self, loop_sum == batch_sum);
+			loop_time += middle - start;
+			batch_time += end - middle;
+		}
+		g_logger->info("  {} reads: find loop {:.0f} us, find_many {:.0f} us", lock_free ? "lock-free" : "locked", loop_time.count() / repetitions, batch_time.count() / repetitions);
+	}
+	return true;
+}
+
+bool cache_test_references(test& self) {
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>, clock_eviction>;
+
+	for (bool per_thread : {false, true}) {
+		{
+			// Eviction must see handles held by other threads, and reclaim the references they left idle
+			cache_t c{cache_options{.shards = 1, .capacity = 4, .per_thread_references = per_thread}};
+			auto held = c.try_emplace(1, "one").first;
+			std::atomic<bool> ok{true};
+
+			std::thread{[&] {
+				auto copy = held;
+				ok = *copy == "one";
+			}}.join();
+			TEST_ASSERT(self, ok);
+			for (int i = 2; i < 50; ++i)
+				c.try_emplace(i, std::to_string(i));
+			TEST_ASSERT(self, *held == "one");
+			TEST_ASSERT(self, c.find(1));
+			held.release();
+			for (int i = 50; i < 100; ++i)
+				c.try_emplace(i, std::to_string(i));
+			TEST_ASSERT(self, !c.find(1));
+			TEST_ASSERT(self, c.size() <= 4);
+		}
+		{
+			// Copies made by one thread count once when per-thread, every time otherwise
+			cache_t c{cache_options{.record_stats = true, .per_thread_references = per_thread}};
+			auto first = c.try_emplace(1, "one").first;
+			auto second = first;
+			auto third = second;
+
+			TEST_ASSERT(self, c.stats().references[per_thread ? 1 : 2] == 1);
+		}
+		// Handles outliving their thread, and caches destroyed while threads keep idle references
+		for (int round = 0; round < 10; ++round) {
+			cache_t c{cache_options{.shards = 2, .capacity = 64, .lock_free_reads = round % 2 == 0, .per_thread_references = per_thread}};
+			std::atomic<bool> ok{true};
+			std::vector<cache_t::value_t> kept(4);
+			std::vector<std::thread> threads;
+
+			for (int t = 0; t < 4; ++t) {
+				threads.emplace_back([&, t] {
+					for (int i = 0; i < 2000; ++i) {
+						int key = (i * 7 + t) % 200;
+						auto value = c.find(key);
+
+						if (!value)
+							value = c.try_emplace(key, std::to_string(key)).first;
+
+						auto copy = value;
+						auto copy_of_copy = copy;
+						if (*copy_of_copy != std::to_string(key))
+							ok = false;
+						if (i == 1000)
+							kept[t] = copy;
+					}
+					c.sweep(64);
+				});
+			}
+			for (auto& thread : threads)
+				thread.join();
+			TEST_ASSERT(self, ok);
+			TEST_ASSERT(self, std::ranges::all_of(kept, [](auto const& value) { return static_cast<bool>(value); }));
+		}
+	}
+	return true;
+}
+
+bool cache_bench_reference_copies(test& self) {
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>>;
+	constexpr int iterations = 1'000'000;
+	unsigned max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (bool per_thread : {false, true}) {
+		cache_t c{cache_options{.per_thread_references = per_thread}};
+		auto hot = c.try_emplace(1, "hot").first;
+
+		for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+			std::atomic<bool> ok{true};
+			std::vector<std::thread> threads;
+			auto start = std::chrono::steady_clock::now();
+
+			for (unsigned t = 0; t < num_threads; ++t) {
+				threads.emplace_back([&] {
+					for (int i = 0; i < iterations; ++i) {
+						cache_t::value_t copy = hot;
+
+						if (!copy)
+							ok = false;
+					}
+				});
+			}
+			for (auto& thread : threads)
+				thread.join();
+			std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+			TEST_ASSERT(self, ok);
+			g_logger->info("  {} counts, {} threads: {:.1f} Mcopies/s", per_thread ? "per-thread" : "shared", num_threads, num_threads * iterations / elapsed.count());
+		}
+	}
+	return true;
+}
+
+bool cache_test_snapshot(test& self) {
+	using namespace std::chrono_literals;
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>>;
+	using vector_cache_t = cache<std::string, std::vector<int>, std::hash<std::string>, std::equal_to<>>;
+	auto path = std::filesystem::temp_directory_path() / "shion_cache_test.snapshot";
+	auto other_path = std::filesystem::temp_directory_path() / "shion_cache_test_2.snapshot";
+
+	{
+		cache_t c{cache_options{.shards = 4}};
+
+		for (int i = 0; i < 1000; ++i)
+			c.try_emplace(i, std::to_string(i));
+		c.try_emplace_for(1ns, 5000, "expired");
+		std::this_thread::sleep_for(1ms);
+		TEST_ASSERT(self, c.save_snapshot(path));
+		TEST_ASSERT(self, !std::filesystem::exists(std::filesystem::path{path} += ".tmp"));
+	}
+	{
+		// Entries are only deserialized when looked up
+		cache_t c{cache_options{.shards = 4, .record_stats = true}};
+
+		TEST_ASSERT(self, c.open_snapshot(path));
+		TEST_ASSERT(self, c.size() == 0);
+		TEST_ASSERT(self, *c.find(42) == "42");
+		TEST_ASSERT(self, c.size() == 1);
+		TEST_ASSERT(self, !c.find(5000));
+		TEST_ASSERT(self, !c.find(1000));
+
+		auto [value, inserted] = c.try_emplace(7, "other");
+		TEST_ASSERT(self, !inserted && *value == "7");
+		TEST_ASSERT(self, *c.get_or_load(8, [] { return std::string{"loaded"}; }) == "8");
+		TEST_ASSERT(self, *c.get_or_load(2000, [] { return std::string{"loaded"}; }) == "loaded");
+
+		std::vector<int> keys{1, 2, 42, 3000, 999};
+		auto found = c.find_many(std::span{keys});
+		TEST_ASSERT(self, *found[0] == "1" && *found[1] == "2" && *found[2] == "42" && !found[3] && *found[4] == "999");
+		TEST_ASSERT(self, c.stats().entries == 7);
+
+		// Saving copies the entries not looked up yet as they are
+		cache_t copy;
+		TEST_ASSERT(self, c.save_snapshot(other_path));
+		TEST_ASSERT(self, copy.open_snapshot(other_path));
+		for (int i = 0; i < 1000; ++i) {
+			auto copied = copy.find(i);
+			TEST_ASSERT(self, copied && *copied == std::to_string(i));
+		}
+		TEST_ASSERT(self, *copy.find(2000) == "loaded");
+		TEST_ASSERT(self, copy.size() == 1001);
+
+		// Saving over the open snapshot
+		TEST_ASSERT(self, c.save_snapshot(path));
+		TEST_ASSERT(self, *c.find(500) == "500");
+	}
+	{
+		auto missing = std::filesystem::temp_directory_path() / "shion_cache_test_missing" / "snapshot";
+		auto garbage = std::filesystem::temp_directory_path() / "shion_cache_test_garbage.snapshot";
+		cache_t c;
+
+		TEST_ASSERT(self, !c.open_snapshot(missing));
+		TEST_ASSERT(self, !c.save_snapshot(missing));
+		std::ofstream{garbage} << "definitely not a snapshot file at all, no";
+		TEST_ASSERT(self, !c.open_snapshot(garbage));
+		std::filesystem::remove(garbage);
+	}
+	{
+		// A corrupt slot table without any empty slot must not make lookups probe forever
+		std::vector<char> bytes;
+		{
+			std::ifstream in{path, std::ios::binary};
+			bytes.assign(std::istreambuf_iterator<char>{in}, {});
+		}
+
+		// Header: magic, version, byte order, entries, number of slots, offset of the slots
+		std::uint64_t num_slots;
+		std::uint64_t slots_offset;
+		std::memcpy(&num_slots, bytes.data() + 24, sizeof(num_slots));
+		std::memcpy(&slots_offset, bytes.data() + 32, sizeof(slots_offset));
+		TEST_ASSERT(self, slots_offset + num_slots * 3 * sizeof(std::uint64_t) <= bytes.size());
+		for (std::uint64_t i = 0; i < num_slots; ++i) {
+			std::uint64_t const slot[3] = {~std::uint64_t{0}, 1, 0};
+			std::memcpy(bytes.data() + slots_offset + i * sizeof(slot), slot, sizeof(slot));
+		}
+		std::ofstream{other_path, std::ios::binary}.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+		cache_t c;
+		TEST_ASSERT(self, c.open_snapshot(other_path));
+		TEST_ASSERT(self, !c.find(42));
+		TEST_ASSERT(self, *c.try_emplace(42, "new").first == "new");
+	}
+	{
+		// Records too short for their value are treated as missing rather than read past
+		std::vector<char> bytes;
+		{
+			std::ifstream in{path, std::ios::binary};
+			bytes.assign(std::istreambuf_iterator<char>{in}, {});
+		}
+
+		std::uint64_t num_slots;
+		std::uint64_t slots_offset;
+		std::memcpy(&num_slots, bytes.data() + 24, sizeof(num_slots));
+		std::memcpy(&slots_offset, bytes.data() + 32, sizeof(slots_offset));
+		for (std::uint64_t i = 0; i < num_slots; ++i) {
+			std::uint64_t const size = sizeof(int) + 1;
+			std::memcpy(bytes.data() + slots_offset + i * 3 * sizeof(std::uint64_t) + 2 * sizeof(std::uint64_t), &size, sizeof(size));
+		}
+		std::ofstream{other_path, std::ios::binary}.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+		cache_t c;
+		TEST_ASSERT(self, c.open_snapshot(other_path));
+		TEST_ASSERT(self, !c.find(42));
+		TEST_ASSERT(self, !c.find(999));
+		TEST_ASSERT(self, *c.try_emplace(42, "new").first == "new");
+		TEST_ASSERT(self, c.size() == 1);
+	}
+	{
+		vector_cache_t c{cache_options{.shards = 2}};
+
+		for (int i = 0; i < 100; ++i)
+			c.try_emplace("k" + std::to_string(i), std::vector<int>{i, i * 2, i * 3});
+		TEST_ASSERT(self, c.save_snapshot(path));
+
+		// Entries from a snapshot count against the capacity
+		vector_cache_t bounded{cache_options{.shards = 2, .capacity = 10}};
+		TEST_ASSERT(self, bounded.open_snapshot(path));
+		for (int i = 0; i < 100; ++i) {
+			auto found = bounded.find("k" + std::to_string(i));
+			TEST_ASSERT(self, found && *found == (std::vector<int>{i, i * 2, i * 3}));
+		}
+		TEST_ASSERT(self, bounded.size() <= 10);
+		TEST_ASSERT(self, !bounded.find(std::string{"k5"}));
+	}
+	{
+		cache_t c{cache_options{.shards = 8}};
+
+		for (int i = 0; i < 20000; ++i)
+			c.try_emplace(i, std::to_string(i));
+		TEST_ASSERT(self, c.save_snapshot(path));
+
+		cache_t warm{cache_options{.shards = 8, .lock_free_reads = true}};
+		std::atomic<bool> ok{true};
+		std::vector<std::thread> threads;
+
+		TEST_ASSERT(self, warm.open_snapshot(path));
+		for (int t = 0; t < 4; ++t) {
+			threads.emplace_back([&, t] {
+				for (int i = 0; i < 20000; ++i) {
+					int key = (i * 7 + t * 13) % 20000;
+
+					if (auto found = warm.find(key); !found || *found != std::to_string(key))
+						ok = false;
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		TEST_ASSERT(self, ok);
+		TEST_ASSERT(self, warm.size() == 20000);
+	}
+	std::filesystem::remove(path);
+	std::filesystem::remove(other_path);
+	return true;
+}
+
+bool cache_bench_snapshot(test& self) {
+	using cache_t = cache<int, std::string, std::hash<int>, std::equal_to<>>;
+	constexpr int num_entries = 100'000;
+	auto path = std::filesystem::temp_directory_path() / "shion_cache_bench.snapshot";
+	std::string payload(200, 'x');
+	cache_t c{cache_options{.shards = 16}};
+
+	for (int i = 0; i < num_entries; ++i)
+		c.try_emplace(i, payload + std::to_string(i));
+
+	auto start = std::chrono::steady_clock::now();
+	TEST_ASSERT(self, c.save_snapshot(path));
+	auto saved = std::chrono::steady_clock::now();
+	cache_t warm{cache_options{.shards = 16}};
+	TEST_ASSERT(self, warm.open_snapshot(path));
+	auto opened = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_entries; i += 100)
+		TEST_ASSERT(self, warm.find(i));
+	auto looked_up = std::chrono::steady_clock::now();
+	cache_t rebuilt{cache_options{.shards = 16}};
+	for (int i = 0; i < num_entries; ++i)
+		rebuilt.try_emplace(i, payload + std::to_string(i));
+	auto end = std::chrono::steady_clock::now();
+
+	auto ms = [](auto from, auto to) {
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	};
+	g_logger->info("  {} entries: save {:.1f} ms, open {:.3f} ms, 1% lookups {:.1f} ms, rebuild {:.1f} ms", num_entries, ms(start, saved), ms(saved, opened), ms(opened, looked_up), ms(looked_up, end));
+	std::filesystem::remove(path);
+	return true;
+}
+
+}
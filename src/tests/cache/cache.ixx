@@ -0,0 +1,25 @@
+module;
+
+export module shion.tests:cache;
+
+import :suite;
+
+namespace shion::tests
+{
+
+bool cache_test_shards(test& self);
+bool cache_test_index(test& self);
+bool cache_test_eviction(test& self);
+bool cache_test_expiry(test& self);
+bool cache_test_load(test& self);
+bool cache_test_stats(test& self);
+bool cache_test_lock_free_reads(test& self);
+bool cache_bench_find(test& self);
+bool cache_test_batch_find(test& self);
+bool cache_bench_batch_find(test& self);
+bool cache_test_references(test& self);
+bool cache_bench_reference_copies(test& self);
+bool cache_test_snapshot(test& self);
+bool cache_bench_snapshot(test& self);
+
+}
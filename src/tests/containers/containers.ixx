@@ -9,6 +9,21 @@ namespace shion::tests
 
 bool hive_test_nontrivial(test& self);
 bool hive_test_trivial(test& self);
+bool hive_test_bulk(test& self);
+bool hive_test_segments(test& self);
+bool hive_test_parallel_for_each(test& self);
+bool hive_test_allocator(test& self);
+bool hive_test_trim(test& self);
+bool hive_test_compact(test& self);
+bool hive_test_get_iterator(test& self);
+bool hive_test_handles(test& self);
+bool hive_test_concurrent(test& self);
+bool hive_test_soa(test& self);
+bool hive_bench_emplace(test& self);
+bool hive_bench_iteration(test& self);
+bool hive_bench_compact(test& self);
+bool hive_bench_copy(test& self);
+bool hive_bench_parallel_for_each(test& self);
 
 bool shelf_tests_insert_erase(test& self);
 
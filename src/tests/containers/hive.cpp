@@ -9,6 +9,18 @@ module;
 #include <source_location>
 #include <optional>
 #include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
+#include <thread>
+#include <cmath>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <ranges>
 
 #include "../tests.hpp"
 
@@ -182,6 +194,22 @@ bool hive_test(test& self) {
 	TEST_ASSERT(self, *h.begin() == 21 && *(++result.first) == 4 * hive::elements_per_page);
 	TEST_ASSERT(self, h.pages() == 3);
 	TEST_ASSERT(self, h.size() == 5);
+	result = h.try_emplace(hive::elements_per_page + 5, hive::elements_per_page + 5);
+	TEST_ASSERT(self, result.second);
+	TEST_ASSERT(self, result.first.raw_index() == hive::elements_per_page + 5);
+	TEST_ASSERT(self, h.at_raw_index(hive::elements_per_page + 5) == result.first);
+	TEST_ASSERT(self, *(++result.first) == 2 * hive::elements_per_page);
+	TEST_ASSERT(self, h.pages() == 4);
+	TEST_ASSERT(self, h.size() == 6);
+	TEST_ASSERT(self, h.erase(h.at_raw_index(4 * hive::elements_per_page)) == h.end());
+	TEST_ASSERT(self, h.last_raw_index() == 2 * hive::elements_per_page);
+
+	if constexpr (std::is_copy_constructible_v<T>) {
+		hive copy{h};
+		TEST_ASSERT(self, copy.size() == h.size());
+		TEST_ASSERT(self, *copy.at_raw_index(hive::elements_per_page + 5) == hive::elements_per_page + 5);
+		TEST_ASSERT(self, std::addressof(*copy.at_raw_index(21)) != std::addressof(*h.at_raw_index(21)));
+	}
 
 
 	if constexpr (std::is_copy_constructible_v<T>) {
@@ -216,4 +244,884 @@ bool hive_test_nontrivial(test& self) {
 	return hive_test<non_trivial>(self);
 }
 
+template <typename T>
+bool hive_bulk_test(test& self) {
+	using hive = shion::hive<T>;
+	hive h;
+
+	h.emplace_n(hive::elements_per_page + 70, 7);
+	TEST_ASSERT(self, h.size() == hive::elements_per_page + 70);
+	TEST_ASSERT(self, h.pages() == 2);
+	TEST_ASSERT(self, h.last_raw_index() == hive::elements_per_page + 69);
+
+	ssize_t i = 0;
+	for (auto it = h.begin(); it != h.end(); ++it, ++i) {
+		TEST_ASSERT(self, *it == 7);
+		if (i % 3 == 0) {
+			*it = T{i};
+		}
+	}
+	auto erased = h.erase_if([](const T& value) { return !(value == 7); });
+	TEST_ASSERT(self, erased == (hive::elements_per_page + 70 + 2) / 3);
+	TEST_ASSERT(self, h.size() == hive::elements_per_page + 70 - erased);
+	TEST_ASSERT(self, h.at_raw_index(0) == h.end());
+	TEST_ASSERT(self, *h.at_raw_index(1) == 7);
+
+	std::vector<ssize_t> values(200);
+	std::iota(values.begin(), values.end(), 1000);
+	h.insert(values);
+	TEST_ASSERT(self, h.size() == hive::elements_per_page + 270 - erased);
+	TEST_ASSERT(self, *h.at_raw_index(0) == 1000);
+	TEST_ASSERT(self, *h.at_raw_index(3) == 1001);
+	TEST_ASSERT(self, h.pages() == 2);
+
+	erased = h.erase_if([](const T&) { return true; });
+	TEST_ASSERT(self, erased == hive::elements_per_page + 270 - (hive::elements_per_page + 70 + 2) / 3);
+	TEST_ASSERT(self, h.size() == 0 && h.begin() == h.end() && h.last_raw_index() == -1);
+
+	h.insert(values);
+	TEST_ASSERT(self, h.size() == 200 && h.last_raw_index() == 199);
+	i = 0;
+	for (auto it = h.begin(); it != h.end(); ++it, ++i) {
+		TEST_ASSERT(self, *it == values[i]);
+	}
+	return true;
+}
+
+bool hive_test_bulk(test& self) {
+	if (!hive_bulk_test<ssize_t>(self))
+		return false;
+
+	if (!hive_bulk_test<non_trivial>(self))
+		return false;
+
+	// A full skipfield word filled from a range
+	shion::hive<ssize_t> words;
+
+	words.insert(std::views::iota(0_sst, 64_sst));
+	TEST_ASSERT(self, words.size() == 64 && words.last_raw_index() == 63);
+	for (ssize_t i = 0; i < 64; ++i) {
+		TEST_ASSERT(self, *words.at_raw_index(i) == i);
+	}
+	TEST_ASSERT(self, words.emplace(64).raw_index() == 64);
+
+	// New pages go to the lowest hole in the directory, across directory words
+	shion::hive<ssize_t> h;
+	auto                 per_page = shion::hive<ssize_t>::elements_per_page;
+
+	for (ssize_t page = 0; page < 130; ++page) {
+		if (page == 3 || page == 70)
+			continue;
+		for (ssize_t i = 0; i < per_page; ++i) {
+			h.try_emplace(page * per_page + i, 1);
+		}
+	}
+	TEST_ASSERT(self, h.pages() == 128);
+	TEST_ASSERT(self, h.emplace(2).raw_index() == 3 * per_page);
+	h.emplace_n(2 * per_page, 3);
+	TEST_ASSERT(self, *h.at_raw_index(4 * per_page - 1) == 3);
+	TEST_ASSERT(self, *h.at_raw_index(70 * per_page) == 3);
+	TEST_ASSERT(self, *h.at_raw_index(130 * per_page) == 3);
+	TEST_ASSERT(self, h.pages() == 131);
+	return true;
+}
+
+bool hive_test_segments(test& self) {
+	using hive = shion::hive<ssize_t>;
+	hive h;
+	std::vector<ssize_t> sizes;
+	ssize_t sum = 0;
+
+	h.for_each_segment([&sizes](std::span<ssize_t> segment) { sizes.push_back(std::ssize(segment)); });
+	TEST_ASSERT(self, sizes.empty());
+
+	h.emplace_n(2 * hive::elements_per_page, 1);
+	h.for_each_segment([&sizes](std::span<ssize_t> segment) { sizes.push_back(std::ssize(segment)); });
+	TEST_ASSERT(self, std::ssize(sizes) == 2 * hive::elements_per_page / 64);
+	TEST_ASSERT(self, std::ranges::all_of(sizes, [](ssize_t size) { return size == 64; }));
+
+	h.erase_if([i = 0](ssize_t) mutable { return (i++ % 8) == 0; });
+	h.erase(h.at_raw_index(hive::elements_per_page + 3));
+	h.erase(h.at_raw_index(2 * hive::elements_per_page - 1));
+	sizes.clear();
+	h.for_each_segment([&sizes](std::span<ssize_t> segment) {
+		sizes.push_back(std::ssize(segment));
+		for (ssize_t& value : segment) {
+			value = 2;
+		}
+	});
+	TEST_ASSERT(self, std::ssize(sizes) == 2 * hive::elements_per_page / 8 + 1);
+	TEST_ASSERT(self, sizes[0] == 7);
+	TEST_ASSERT(self, sizes.back() == 6);
+	TEST_ASSERT(self, std::accumulate(sizes.begin(), sizes.end(), 0_sst) == h.size());
+
+	std::as_const(h).for_each([&sum](ssize_t const& value) { sum += value; });
+	TEST_ASSERT(self, sum == 2 * h.size());
+	for (auto it = h.begin(); it != h.end(); ++it) {
+		sum -= *it;
+	}
+	TEST_ASSERT(self, sum == 0);
+	return true;
+}
+
+bool hive_test_parallel_for_each(test& self) {
+	using hive = shion::hive<ssize_t>;
+	hive h;
+
+	h.emplace_n(5 * hive::elements_per_page + 7, 1);
+	h.erase_if([i = 0](ssize_t) mutable { return (i++ % 5) == 0; });
+	h.parallel_for_each(3, [](ssize_t& value) { value += 2; });
+
+	ssize_t mismatches = 0;
+	h.for_each([&mismatches](ssize_t value) { mismatches += (value != 3); });
+	TEST_ASSERT(self, mismatches == 0);
+
+	bool thrown = false;
+	try {
+		h.parallel_for_each(2, [](ssize_t&) { throw std::runtime_error{"meow"}; });
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	TEST_ASSERT(self, thrown);
+
+	// If the executor throws, the job it already started is stopped and waited for before the exception escapes
+	std::vector<std::jthread> threads;
+	std::atomic<ssize_t>      calls = 0;
+	thrown = false;
+	try {
+		h.parallel_for_each([&threads](auto const& job) {
+			if (std::ssize(threads) == 1) {
+				throw std::runtime_error{"meow"};
+			}
+			threads.emplace_back(job);
+		}, 4, [&calls](ssize_t&) { calls.fetch_add(1, std::memory_order_relaxed); });
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	TEST_ASSERT(self, thrown);
+	auto seen = calls.load();
+	threads.clear();
+	TEST_ASSERT(self, calls.load() == seen);
+	TEST_ASSERT(self, seen <= h.size());
+	return true;
+}
+
+struct allocation_counters {
+	ssize_t allocations = 0;
+	ssize_t deallocations = 0;
+	ssize_t live_bytes = 0;
+};
+
+template <typename T>
+struct counting_allocator {
+	using value_type = T;
+
+	counting_allocator(allocation_counters* c) noexcept : counters{c} {}
+
+	template <typename U>
+	counting_allocator(counting_allocator<U> const& rhs) noexcept : counters{rhs.counters} {}
+
+	T* allocate(size_t n) {
+		++counters->allocations;
+		counters->live_bytes += n * sizeof(T);
+		return std::allocator<T>{}.allocate(n);
+	}
+
+	void deallocate(T* p, size_t n) noexcept {
+		++counters->deallocations;
+		counters->live_bytes -= n * sizeof(T);
+		std::allocator<T>{}.deallocate(p, n);
+	}
+
+	template <typename U>
+	friend bool operator==(counting_allocator const& lhs, counting_allocator<U> const& rhs) noexcept {
+		return lhs.counters == rhs.counters;
+	}
+
+	allocation_counters* counters;
+};
+
+bool hive_test_allocator(test& self) {
+	// Pages fit in their target size bookkeeping included, unless a single group of 64 elements does not
+	using huge_page_hive = shion::hive<char, shion::hive_page_size<2 * 1024 * 1024>>;
+	static_assert(huge_page_hive::elements_per_page == (2 * 1024 * 1024 - 3 * sizeof(ssize_t)) / (sizeof(uint64) + 64) * 64);
+	TEST_ASSERT(self, huge_page_hive{}.page_size_bytes() <= 2 * 1024 * 1024);
+	TEST_ASSERT(self, shion::hive<int>{}.page_size_bytes() <= 24 * 1024);
+	TEST_ASSERT(self, shion::handle_hive<int>{}.page_size_bytes() <= 24 * 1024);
+	TEST_ASSERT(self, shion::hive<int>{}.page_size_bytes() > 23 * 1024);
+	static_assert(shion::hive<std::array<char, 4096>, shion::hive_page_size<1024>>::elements_per_page == 64);
+
+	using page_size = shion::hive_page_size<2048>;
+	using hive = shion::hive<ssize_t, page_size, counting_allocator<ssize_t>>;
+	static_assert(hive::elements_per_page == 192);
+
+	allocation_counters counters;
+	allocation_counters other_counters;
+	ssize_t live_bytes = 0;
+	{
+		hive h{counting_allocator<ssize_t>{&counters}};
+
+		h.emplace_n(4 * hive::elements_per_page, 1);
+		TEST_ASSERT(self, h.pages() == 4);
+		TEST_ASSERT(self, h.get_allocator().counters == &counters);
+		live_bytes = counters.live_bytes;
+		TEST_ASSERT(self, live_bytes >= h.size_bytes());
+
+		h.clear();
+		TEST_ASSERT(self, h.size() == 0);
+		TEST_ASSERT(self, h.pages() == 0);
+		TEST_ASSERT(self, h.capacity() == 0);
+		TEST_ASSERT(self, h.pooled_pages() == 4);
+		TEST_ASSERT(self, h.size_bytes() == 4 * h.page_size_bytes());
+		TEST_ASSERT(self, counters.live_bytes == live_bytes);
+
+		// Pooled pages are reused, including out of order through try_emplace
+		h.try_emplace(3 * hive::elements_per_page, 2);
+		h.emplace_n(3 * hive::elements_per_page, 1);
+		TEST_ASSERT(self, h.pages() == 4);
+		TEST_ASSERT(self, h.pooled_pages() == 0);
+		TEST_ASSERT(self, counters.live_bytes == live_bytes);
+		TEST_ASSERT(self, h.size() == 3 * hive::elements_per_page + 1);
+
+		hive copy = h;
+		TEST_ASSERT(self, copy.size() == h.size());
+		TEST_ASSERT(self, copy.pages() == h.pages());
+		TEST_ASSERT(self, *copy.at_raw_index(3 * hive::elements_per_page) == 2);
+
+		hive moved = std::move(copy);
+		TEST_ASSERT(self, moved.size() == h.size());
+		TEST_ASSERT(self, copy.size() == 0);
+		TEST_ASSERT(self, copy.pages() == 0);
+
+		ssize_t sum = 0;
+		moved.for_each([&sum](ssize_t value) { sum += value; });
+		TEST_ASSERT(self, sum == h.size() + 1);
+
+		// Allocators compare unequal and do not propagate, so elements are moved into pages from `other_counters`
+		hive other{counting_allocator<ssize_t>{&other_counters}};
+		other = std::move(moved);
+		TEST_ASSERT(self, other.size() == h.size());
+		TEST_ASSERT(self, moved.size() == 0);
+		TEST_ASSERT(self, other_counters.live_bytes >= other.size_bytes());
+	}
+	TEST_ASSERT(self, counters.allocations == counters.deallocations);
+	TEST_ASSERT(self, counters.live_bytes == 0);
+	TEST_ASSERT(self, other_counters.live_bytes == 0);
+	return true;
+}
+
+bool hive_test_trim(test& self) {
+	using hive = shion::hive<ssize_t>;
+	hive h;
+
+	h.emplace_n(4 * hive::elements_per_page, 1);
+	auto full_bytes = h.size_bytes();
+
+	// Emptying a page takes it out of iteration and into the pool, without freeing it yet
+	for (ssize_t i = hive::elements_per_page; i < 2 * hive::elements_per_page; ++i) {
+		h.erase(h.at_raw_index(i));
+	}
+	TEST_ASSERT(self, h.pages() == 3);
+	TEST_ASSERT(self, h.pooled_pages() == 1);
+	TEST_ASSERT(self, h.capacity() == 3 * hive::elements_per_page);
+	TEST_ASSERT(self, h.size_bytes() == full_bytes);
+	TEST_ASSERT(self, h.at_raw_index(hive::elements_per_page) == h.end());
+
+	// The pooled page is reused for the next page
+	h.emplace(2);
+	TEST_ASSERT(self, h.pages() == 4);
+	TEST_ASSERT(self, h.pooled_pages() == 0);
+	TEST_ASSERT(self, *h.at_raw_index(hive::elements_per_page) == 2);
+
+	h.erase_if([](ssize_t value) { return value == 2; });
+	TEST_ASSERT(self, h.pooled_pages() == 1);
+	h.erase(h.at_raw_index(4 * hive::elements_per_page - 1));
+	TEST_ASSERT(self, h.last_raw_index() == 4 * hive::elements_per_page - 2);
+	h.erase_if([](ssize_t) { return true; }); // Only erases the remaining 3 pages
+	TEST_ASSERT(self, h.size() == 0);
+	TEST_ASSERT(self, h.pages() == 0);
+	TEST_ASSERT(self, h.pooled_pages() == 4);
+	TEST_ASSERT(self, h.size_bytes() == full_bytes);
+
+	h.trim(1);
+	TEST_ASSERT(self, h.pooled_pages() == 1);
+	TEST_ASSERT(self, h.size_bytes() == h.page_size_bytes());
+	h.shrink_to_fit();
+	TEST_ASSERT(self, h.pooled_pages() == 0);
+	TEST_ASSERT(self, h.size_bytes() == 0);
+
+	// Past the limit, the pool is trimmed to half of it: 8 pages are retired, trimming to 2 on the 5th and the 8th
+	h.set_max_pooled_pages(4);
+	h.emplace_n(8 * hive::elements_per_page, 1);
+	h.erase_if([](ssize_t) { return true; });
+	TEST_ASSERT(self, h.pages() == 0);
+	TEST_ASSERT(self, h.pooled_pages() == 2);
+
+	// Going back and forth across a page boundary reuses the pooled page
+	for (ssize_t i = 0; i < 8; ++i) {
+		h.erase(h.emplace(1));
+		TEST_ASSERT(self, h.pooled_pages() == 2);
+	}
+	h.set_max_pooled_pages(1);
+	TEST_ASSERT(self, h.pooled_pages() == 0);
+	TEST_ASSERT(self, h.size_bytes() == 0);
+	h.emplace(1);
+	TEST_ASSERT(self, h.pages() == 1);
+	TEST_ASSERT(self, h.size() == 1);
+
+	// Copies and assignments carry the pool limit
+	hive assigned;
+	assigned = h;
+	TEST_ASSERT(self, assigned.max_pooled_pages() == 1);
+	TEST_ASSERT(self, hive{h}.max_pooled_pages() == 1);
+	hive moved;
+	moved = std::move(assigned);
+	TEST_ASSERT(self, moved.max_pooled_pages() == 1);
+
+	// Retired pages leave holes that new pages fill lowest first, across directory words
+	using small_hive = shion::hive<ssize_t, shion::hive_page_size<512>>;
+	small_hive s;
+	auto       per_page = small_hive::elements_per_page;
+
+	s.emplace_n(130 * per_page, 1);
+	for (ssize_t page : {70, 3}) {
+		s.erase_if([&](ssize_t const& value) { return s.get_iterator(&value).raw_index() / per_page == page; });
+	}
+	TEST_ASSERT(self, s.pages() == 128);
+	TEST_ASSERT(self, s.emplace(2).raw_index() == 3 * per_page);
+	s.emplace_n(2 * per_page, 3);
+	TEST_ASSERT(self, *s.at_raw_index(4 * per_page - 1) == 3);
+	TEST_ASSERT(self, *s.at_raw_index(70 * per_page) == 3);
+	TEST_ASSERT(self, *s.at_raw_index(130 * per_page) == 3);
+	TEST_ASSERT(self, s.pages() == 131);
+	return true;
+}
+
+bool hive_test_get_iterator(test& self) {
+	using hive = shion::hive<ssize_t>;
+	hive h;
+	ssize_t outside = 0;
+
+	TEST_ASSERT(self, h.get_iterator(&outside) == h.end());
+
+	// Churn pages through the pool so their addresses are not in index order
+	h.emplace_n(8 * hive::elements_per_page, 1);
+	for (ssize_t page : {6, 1, 3}) {
+		h.erase_if([page, i = 0_sst](ssize_t) mutable { return (i++ / hive::elements_per_page) == page; });
+	}
+	h.emplace_n(3 * hive::elements_per_page + 5, 2);
+	h.erase(h.at_raw_index(4 * hive::elements_per_page + 7));
+
+	ssize_t count = 0;
+	for (auto it = h.begin(); it != h.end(); ++it) {
+		TEST_ASSERT(self, h.get_iterator(std::addressof(*it)) == it);
+		++count;
+	}
+	TEST_ASSERT(self, count == h.size());
+	TEST_ASSERT(self, h.get_iterator(&outside) == h.end());
+
+	// Slots that hold no element are not found
+	auto& in_hole = *h.at_raw_index(4 * hive::elements_per_page + 6);
+	TEST_ASSERT(self, h.get_iterator(&in_hole + 1) == h.end());
+
+	// Pooled pages are still indexed, but hold no elements
+	h.clear();
+	TEST_ASSERT(self, h.get_iterator(&in_hole) == h.end());
+
+	// Pages released by trim are no longer indexed, and reused ones are found again
+	h.trim(3);
+	TEST_ASSERT(self, h.pooled_pages() == 3);
+	h.emplace_n(5 * hive::elements_per_page, 3);
+	count = 0;
+	for (auto it = h.begin(); it != h.end(); ++it) {
+		TEST_ASSERT(self, h.get_iterator(std::addressof(*it)) == it);
+		++count;
+	}
+	TEST_ASSERT(self, count == h.size());
+	return true;
+}
+
+bool hive_test_handles(test& self) {
+	using hive = shion::handle_hive<ssize_t>;
+	hive h;
+
+	// Only hives with handles pay for a generation per slot
+	constexpr auto has_handles = []<typename H>(std::type_identity<H>) {
+		return requires (typename H::iterator it) { it.to_handle(); };
+	};
+	TEST_ASSERT(self, has_handles(std::type_identity<hive>{}));
+	TEST_ASSERT(self, !has_handles(std::type_identity<shion::hive<ssize_t>>{}));
+	shion::hive<ssize_t> plain;
+	TEST_ASSERT(self, h.page_size_bytes() / h.page_capacity() >= ssize_t{sizeof(ssize_t) + sizeof(uint32)});
+	TEST_ASSERT(self, plain.page_size_bytes() / plain.page_capacity() < ssize_t{sizeof(ssize_t) + sizeof(uint32)});
+
+	TEST_ASSERT(self, h.find(hive::handle{}) == h.end());
+	TEST_ASSERT(self, h.get(hive::handle{}) == nullptr);
+
+	auto first = h.emplace(1).to_handle();
+	auto second = h.emplace(2).to_handle();
+	TEST_ASSERT(self, first != second);
+	TEST_ASSERT(self, h.get(first) != nullptr && *h.get(first) == 1);
+	TEST_ASSERT(self, h.find(second) == h.at_raw_index(1));
+
+	// The slot is reused, but the new element gets a new generation
+	h.erase(h.find(first));
+	TEST_ASSERT(self, h.get(first) == nullptr);
+	auto reused = h.emplace(3).to_handle();
+	TEST_ASSERT(self, reused.index == first.index);
+	TEST_ASSERT(self, h.get(first) == nullptr);
+	TEST_ASSERT(self, *h.get(reused) == 3);
+
+	// Same through a pooled page placed back at the same index, and through bulk construction
+	h.erase_if([](ssize_t) { return true; });
+	TEST_ASSERT(self, h.pooled_pages() == 1);
+	h.emplace_n(hive::elements_per_page + 1, 4);
+	TEST_ASSERT(self, h.get(second) == nullptr && h.get(reused) == nullptr);
+	auto bulk = h.at_raw_index(1).to_handle();
+	TEST_ASSERT(self, bulk.index == second.index && bulk != second);
+	TEST_ASSERT(self, h.at_raw_index(2).to_handle().generation != bulk.generation);
+
+	// Handles only need their index updated when elements are relocated
+	auto last = h.at_raw_index(hive::elements_per_page).to_handle();
+	h.erase(h.at_raw_index(0));
+	h.compact([&last](ssize_t from, ssize_t to) {
+		if (from == last.index)
+			last.index = to;
+	});
+	TEST_ASSERT(self, last.index == 0);
+	TEST_ASSERT(self, h.get(last) != nullptr && *h.get(last) == 4);
+
+	// Copies keep the generations of the original
+	hive copy = h;
+	TEST_ASSERT(self, *copy.get(bulk) == 4);
+	TEST_ASSERT(self, std::as_const(copy).get(last) == std::addressof(*copy.at_raw_index(0)));
+	return true;
+}
+
+template <typename T>
+bool hive_compact_test(test& self) {
+	using hive = shion::hive<T>;
+	constexpr ssize_t num_elements = 6 * hive::elements_per_page;
+	constexpr auto value_of = [](T const& value) -> ssize_t {
+		if constexpr (std::is_same_v<T, non_trivial>)
+			return value.i;
+		else
+			return value;
+	};
+	hive h;
+
+	TEST_ASSERT(self, h.compact() == 0);
+	for (ssize_t i = 0; i < num_elements; ++i) {
+		h.emplace(i);
+	}
+	// Leaves holes in every page, empties page 2 entirely and leaves a few elements in page 5
+	h.erase_if([&value_of](T const& value) {
+		ssize_t i = value_of(value);
+		return (i % 3) == 0 || (i / hive::elements_per_page) == 2 || (i / hive::elements_per_page == 5 && i % 64 != 1);
+	});
+	TEST_ASSERT(self, h.pages() == 5);
+
+	std::vector<ssize_t> where(num_elements, -1);
+	for (auto it = h.begin(); it != h.end(); ++it) {
+		where[value_of(*it)] = it.raw_index();
+	}
+	auto size = h.size();
+	bool consistent = true;
+	auto relocated = h.compact([&](ssize_t from, ssize_t to) {
+		ssize_t value = value_of(*h.at_raw_index(to));
+		consistent = consistent && where[value] == from && h.at_raw_index(from) == h.end();
+		where[value] = to;
+	});
+	TEST_ASSERT(self, consistent);
+	TEST_ASSERT(self, relocated > 0);
+	TEST_ASSERT(self, h.size() == size);
+	TEST_ASSERT(self, h.pages() == (size + hive::elements_per_page - 1) / hive::elements_per_page);
+	TEST_ASSERT(self, h.last_raw_index() == size - 1);
+
+	ssize_t count = 0;
+	for (auto it = h.begin(); it != h.end(); ++it) {
+		TEST_ASSERT(self, it.raw_index() == count);
+		TEST_ASSERT(self, where[value_of(*it)] == it.raw_index());
+		++count;
+	}
+	TEST_ASSERT(self, count == size);
+	TEST_ASSERT(self, h.compact() == 0);
+
+	h.emplace(-1);
+	TEST_ASSERT(self, h.last_raw_index() == size);
+
+	// Page 0 has holes before its live elements, and is the last page packed
+	auto packed = [&h]() {
+		ssize_t expected = 0;
+		for (auto it = h.begin(); it != h.end(); ++it) {
+			if (it.raw_index() != expected++)
+				return false;
+		}
+		return expected == h.size();
+	};
+	h.clear();
+	for (ssize_t idx : {5_sst, 10_sst, hive::elements_per_page + 2, hive::elements_per_page + 3}) {
+		h.try_emplace(idx, idx);
+	}
+	TEST_ASSERT(self, h.compact() == 4);
+	TEST_ASSERT(self, packed());
+	TEST_ASSERT(self, h.pages() == 1);
+	TEST_ASSERT(self, value_of(*h.at_raw_index(2)) == 5 && value_of(*h.at_raw_index(3)) == 10);
+
+	// A single sparse page is packed into itself
+	h.clear();
+	h.try_emplace(10, 10);
+	h.try_emplace(20, 20);
+	TEST_ASSERT(self, h.compact() == 2);
+	TEST_ASSERT(self, packed());
+	TEST_ASSERT(self, value_of(*h.at_raw_index(0)) == 10 && value_of(*h.at_raw_index(1)) == 20);
+	TEST_ASSERT(self, h.compact() == 0);
+	return true;
+}
+
+bool hive_test_compact(test& self) {
+	if (!hive_compact_test<ssize_t>(self))
+		return false;
+
+	if (!hive_compact_test<non_trivial>(self))
+		return false;
+
+	return true;
+}
+
+bool hive_test_concurrent(test& self) {
+	using hive = shion::concurrent_hive<ssize_t, shion::hive_page_size<4096>>;
+	constexpr ssize_t num_threads = 8;
+	constexpr ssize_t per_thread = 20'000;
+	hive h;
+
+	TEST_ASSERT(self, h.get(0) == nullptr);
+	TEST_ASSERT(self, !h.erase(0));
+
+	// Every thread spawns its elements, and erases every other one of them as it goes
+	std::vector<std::vector<ssize_t>> kept(num_threads);
+	{
+		std::vector<std::jthread> threads;
+		for (ssize_t t = 0; t < num_threads; ++t) {
+			threads.emplace_back([&h, &kept, t]() {
+				for (ssize_t i = 0; i < per_thread; ++i) {
+					auto index = h.emplace(t * per_thread + i);
+					if (i % 2 == 0) {
+						kept[t].push_back(index);
+					} else {
+						h.erase(index);
+					}
+				}
+			});
+		}
+	}
+	TEST_ASSERT(self, h.size() == num_threads * per_thread / 2);
+	// Erased slots were reused, so at most a page of slack per thread
+	TEST_ASSERT(self, h.capacity() <= h.size() + (num_threads + 1) * hive::elements_per_page);
+
+	ssize_t count = 0;
+	for (ssize_t t = 0; t < num_threads; ++t) {
+		for (ssize_t i = 0; i < std::ssize(kept[t]); ++i) {
+			ssize_t* value = h.get(kept[t][i]);
+			TEST_ASSERT(self, value != nullptr && *value == t * per_thread + 2 * i);
+			++count;
+		}
+	}
+	TEST_ASSERT(self, count == h.size());
+
+	// Concurrent erasers racing on the same elements: each element is erased exactly once
+	std::atomic<ssize_t> erased{0};
+	{
+		std::vector<std::jthread> threads;
+		for (ssize_t t = 0; t < num_threads; ++t) {
+			threads.emplace_back([&h, &kept, &erased]() {
+				for (auto const& indices : kept) {
+					for (ssize_t index : indices) {
+						if (h.erase(index))
+							erased.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+			});
+		}
+	}
+	TEST_ASSERT(self, erased.load() == count);
+	TEST_ASSERT(self, h.size() == 0);
+
+	count = 0;
+	h.for_each([&count](ssize_t) { ++count; });
+	TEST_ASSERT(self, count == 0);
+	return true;
+}
+
+bool hive_test_soa(test& self) {
+	using hive = shion::basic_soa_hive<shion::hive_page_size<4096>, float, ssize_t, std::string>;
+	hive h;
+
+	TEST_ASSERT(self, !h.contains(0));
+	TEST_ASSERT(self, !h.erase(0));
+
+	for (ssize_t i = 0; i < 3 * hive::elements_per_page; ++i) {
+		auto index = h.emplace(static_cast<float>(i), i, std::to_string(i));
+		TEST_ASSERT(self, index == i);
+	}
+	TEST_ASSERT(self, h.pages() == 3);
+	for (ssize_t i = 0; i < 3 * hive::elements_per_page; i += 3) {
+		TEST_ASSERT(self, h.erase(i));
+	}
+	TEST_ASSERT(self, !h.erase(0));
+	TEST_ASSERT(self, h.size() == 2 * hive::elements_per_page);
+	TEST_ASSERT(self, h.get<1>(4) == 4 && h.get<2>(4) == "4");
+
+	// Components are iterated in separate, contiguous spans of equal length
+	ssize_t count = 0;
+	bool consistent = true;
+	h.for_each_segment([&](std::span<float> xs, std::span<ssize_t> ids, std::span<std::string> names) {
+		consistent = consistent && xs.size() == ids.size() && ids.size() == names.size() && xs.size() <= 64;
+		for (size_t i = 0; i < ids.size(); ++i) {
+			consistent = consistent && xs[i] == static_cast<float>(ids[i]) && names[i] == std::to_string(ids[i]) && ids[i] % 3 != 0;
+		}
+		count += std::ssize(ids);
+	});
+	TEST_ASSERT(self, consistent);
+	TEST_ASSERT(self, count == h.size());
+
+	// A kernel over one field only sees that field
+	h.for_each_segment<0>([](std::span<float> xs) {
+		for (float& x : xs) {
+			x *= 2.0f;
+		}
+	});
+	float sum = 0.0f;
+	ssize_t id_sum = 0;
+	h.for_each([&](float x, ssize_t id, std::string const&) {
+		sum += x - 2.0f * static_cast<float>(id);
+		id_sum += id;
+	});
+	TEST_ASSERT(self, sum == 0.0f);
+	h.for_each_segment<1>([&id_sum](std::span<ssize_t const> ids) {
+		for (ssize_t id : ids) {
+			id_sum -= id;
+		}
+	});
+	TEST_ASSERT(self, id_sum == 0);
+
+	// Freed slots are reused first
+	TEST_ASSERT(self, h.emplace(0.0f, -1, "reused") == 0);
+	TEST_ASSERT(self, h.get<2>(0) == "reused");
+	h.clear();
+	TEST_ASSERT(self, h.size() == 0 && !h.contains(4));
+	TEST_ASSERT(self, h.emplace(1.0f, 1, "") == 0);
+
+	// A moved-from hive is empty and can be used again
+	for (ssize_t i = 1; i < 2 * hive::elements_per_page + 1; ++i) {
+		h.emplace(1.0f, i, "");
+	}
+	hive moved{std::move(h)};
+	TEST_ASSERT(self, moved.size() == 2 * hive::elements_per_page + 1 && moved.pages() == 3);
+	TEST_ASSERT(self, h.size() == 0 && h.pages() == 0 && !h.contains(0));
+	TEST_ASSERT(self, h.emplace(2.0f, 2, "moved from") == 0);
+	TEST_ASSERT(self, h.get<2>(0) == "moved from");
+
+	hive assigned;
+	assigned = std::move(moved);
+	TEST_ASSERT(self, assigned.size() == 2 * hive::elements_per_page + 1 && assigned.get<1>(5) == 5);
+	TEST_ASSERT(self, moved.size() == 0 && moved.pages() == 0);
+	TEST_ASSERT(self, moved.emplace(3.0f, 3, "") == 0);
+	return true;
+}
+
+bool hive_bench_emplace(test& self) {
+	using hive = shion::hive<ssize_t>;
+	constexpr ssize_t num_pages = 256;
+	constexpr ssize_t capacity = num_pages * hive::elements_per_page;
+	constexpr ssize_t iterations = 100'000;
+
+	for (ssize_t occupancy : {10, 50, 99}) {
+		hive h;
+		for (ssize_t i = 0; i < capacity; ++i) {
+			h.emplace(i);
+		}
+		// Punch holes evenly so every page sits at the target occupancy
+		for (ssize_t i = 0; i < capacity; ++i) {
+			if (i % 100 >= occupancy) {
+				h.erase(h.at_raw_index(i));
+			}
+		}
+		auto expected_size = h.size();
+		uint64 rng = 0x2545F4914F6CDD1D;
+
+		auto start = app_clock::now();
+		for (ssize_t i = 0; i < iterations; ++i) {
+			rng = rng * 6364136223846793005 + 1442695040888963407;
+			if (auto it = h.at_raw_index(static_cast<ssize_t>((rng >> 33) % capacity)); it != h.end()) {
+				h.erase(it);
+				h.emplace(i);
+			}
+		}
+		auto elapsed = std::chrono::duration<double, std::nano>(app_clock::now() - start);
+
+		TEST_ASSERT(self, h.size() == expected_size);
+		TEST_ASSERT(self, h.pages() == num_pages);
+		g_logger->info("  {: >3}% occupancy: {:.1f} ns per erase + emplace", occupancy, elapsed.count() / iterations);
+	}
+	return true;
+}
+
+bool hive_bench_iteration(test& self) {
+	using hive = shion::hive<ssize_t>;
+	constexpr ssize_t num_elements = 1'000'000;
+	hive h;
+
+	h.emplace_n(num_elements, 1);
+	h.erase_if([i = 0](ssize_t) mutable { return (i++ % 10) == 0; });
+
+	ssize_t sum = 0;
+	auto start = app_clock::now();
+	for (auto it = h.begin(); it != h.end(); ++it) {
+		sum += *it;
+	}
+	auto iterator_time = std::chrono::duration<double, std::milli>(app_clock::now() - start);
+	TEST_ASSERT(self, sum == h.size());
+
+	sum = 0;
+	start = app_clock::now();
+	h.for_each_segment([&sum](std::span<ssize_t const> segment) {
+		for (ssize_t value : segment) {
+			sum += value;
+		}
+	});
+	auto segment_time = std::chrono::duration<double, std::milli>(app_clock::now() - start);
+	TEST_ASSERT(self, sum == h.size());
+
+	g_logger->info("  iterator: {:.3f} ms, for_each_segment: {:.3f} ms", iterator_time.count(), segment_time.count());
+	return true;
+}
+
+bool hive_bench_compact(test& self) {
+	using hive = shion::hive<ssize_t>;
+	constexpr ssize_t num_elements = 4'000'000;
+	hive h;
+
+	// Heavy churn leaves one element in ten, spread over every page
+	h.emplace_n(num_elements, 1);
+	h.erase_if([i = 0](ssize_t) mutable { return (i++ % 10) != 0; });
+
+	auto measure = [&h]() {
+		ssize_t sum = 0;
+		auto    start = app_clock::now();
+		for (auto it = h.begin(); it != h.end(); ++it) {
+			sum += *it;
+		}
+		auto iterator_time = std::chrono::duration<double, std::milli>(app_clock::now() - start);
+
+		start = app_clock::now();
+		h.for_each_segment([&sum](std::span<ssize_t const> segment) {
+			for (ssize_t value : segment) {
+				sum += value;
+			}
+		});
+		auto segment_time = std::chrono::duration<double, std::milli>(app_clock::now() - start);
+		return std::tuple{sum, iterator_time.count(), segment_time.count()};
+	};
+
+	auto pages = h.pages();
+	auto [sum, iterator_time, segment_time] = measure();
+	TEST_ASSERT(self, sum == 2 * h.size());
+	g_logger->info("  before: {} pages, iterator: {:.3f} ms, for_each_segment: {:.3f} ms", pages, iterator_time, segment_time);
+
+	auto start = app_clock::now();
+	auto relocated = h.compact();
+	auto compact_time = std::chrono::duration<double, std::milli>(app_clock::now() - start);
+	TEST_ASSERT(self, h.last_raw_index() == h.size() - 1);
+	g_logger->info("  compact: relocated {} elements in {:.3f} ms", relocated, compact_time.count());
+
+	std::tie(sum, iterator_time, segment_time) = measure();
+	TEST_ASSERT(self, sum == 2 * h.size());
+	g_logger->info("  after: {} pages, iterator: {:.3f} ms, for_each_segment: {:.3f} ms", h.pages(), iterator_time, segment_time);
+	return true;
+}
+
+namespace {
+
+// Trivially copyable, but not trivial: goes through the generic page, which block-copies it
+struct bench_vec3 {
+	float x{};
+	float y{};
+	float z{};
+};
+
+// Same layout, but its user-provided copy constructor forces element-by-element copies
+struct bench_vec3_copyable {
+	bench_vec3_copyable(float x_, float y_, float z_) noexcept : x{x_}, y{y_}, z{z_} {}
+	bench_vec3_copyable(bench_vec3_copyable const& rhs) noexcept : x{rhs.x}, y{rhs.y}, z{rhs.z} {}
+	bench_vec3_copyable& operator=(bench_vec3_copyable const& rhs) noexcept = default;
+
+	float x{};
+	float y{};
+	float z{};
+};
+
+template <typename T>
+std::chrono::duration<double, std::milli> bench_hive_copy(ssize_t num_elements, ssize_t& checksum) {
+	shion::hive<T> h;
+
+	h.emplace_n(num_elements, T{1.0f, 2.0f, 3.0f});
+	h.erase_if([i = 0](T const&) mutable { return (i++ % 10) == 0; });
+
+	auto start = app_clock::now();
+	shion::hive<T> copy{h};
+	auto elapsed = std::chrono::duration<double, std::milli>(app_clock::now() - start);
+
+	checksum = 0;
+	copy.for_each([&checksum](T const& value) { checksum += static_cast<ssize_t>(value.x + value.y + value.z); });
+	return elapsed;
+}
+
+}
+
+bool hive_bench_copy(test& self) {
+	static_assert(std::is_trivially_copyable_v<bench_vec3> && !std::is_trivial_v<bench_vec3>);
+	static_assert(!std::is_trivially_copyable_v<bench_vec3_copyable>);
+	constexpr ssize_t num_elements = 1'000'000;
+	constexpr ssize_t expected = 6 * (num_elements - num_elements / 10);
+
+	ssize_t checksum = 0;
+	auto element_time = bench_hive_copy<bench_vec3_copyable>(num_elements, checksum);
+	TEST_ASSERT(self, checksum == expected);
+	auto block_time = bench_hive_copy<bench_vec3>(num_elements, checksum);
+	TEST_ASSERT(self, checksum == expected);
+
+	g_logger->info("  per element: {:.3f} ms, block copy: {:.3f} ms ({:.2f}x)", element_time.count(), block_time.count(), element_time / block_time);
+	return true;
+}
+
+bool hive_bench_parallel_for_each(test& self) {
+	using hive = shion::hive<double>;
+	constexpr ssize_t num_elements = 4'000'000;
+	hive h;
+
+	h.emplace_n(num_elements, 1.0);
+
+	auto max_threads = std::max(1_sst, static_cast<ssize_t>(std::thread::hardware_concurrency()));
+	double single_thread_time = 0;
+	double expected = 1.0;
+	for (ssize_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		auto start = app_clock::now();
+		h.parallel_for_each(num_threads, [](double& value) {
+			value = std::sqrt(value * value + 3.0);
+		});
+		auto elapsed = std::chrono::duration<double, std::milli>(app_clock::now() - start).count();
+
+		expected = std::sqrt(expected * expected + 3.0);
+		if (num_threads == 1) {
+			single_thread_time = elapsed;
+		}
+		g_logger->info("  {: >3} threads: {:.3f} ms ({:.2f}x)", num_threads, elapsed, single_thread_time / elapsed);
+	}
+	ssize_t mismatches = 0;
+	h.for_each([expected, &mismatches](double value) { mismatches += (value != expected); });
+	TEST_ASSERT(self, mismatches == 0);
+	return true;
+}
+
 }
@@ -11,5 +11,7 @@ bool serializer_helper_fundamental(test& t);
 bool serializer_helper_tuples(test& t);
 bool serializer_helper_contiguous_ranges(test& t);
 bool serializer_helper_list_ranges(test& t);
+bool serializer_helper_hive(test& t);
+bool serializer_helper_views(test& t);
 
 }
@@ -5,6 +5,8 @@ module;
 #if !SHION_IMPORT_STD
 
 #include <cstddef>
+#include <cstring>
+#include <cstdint>
 #include <bit>
 #include <string>
 #include <array>
@@ -16,6 +18,8 @@ module;
 #include <list>
 #include <queue>
 #include <unordered_map>
+#include <vector>
+#include <string_view>
 
 #endif
 
@@ -188,6 +192,53 @@ constexpr bool serializer_helper_ranges_vector_string(test* t)
 	return true;
 }
 
+bool serializer_helper_ranges_vector_int(test* t)
+{
+	std::byte                      big[64]{};
+	std::vector<int>               vec_in{ 1, 2, 4, 0x01020304 };
+	std::vector<int>               vec_out{};
+	shion::serializer_helper<std::vector<int>> test;
+	std::ptrdiff_t expected_size = (1 + vec_in.size() * sizeof(int));
+	auto opposite_endian = std::endian::native == std::endian::big ? std::endian::little : std::endian::big;
+
+	TEST_ASSERT(*t, test.write({}, vec_in) == expected_size);
+	TEST_ASSERT(*t, test.write(big, vec_in) == expected_size);
+	TEST_ASSERT(*t, test.size(big) == expected_size);
+	TEST_ASSERT(*t, test.read(big, vec_out) == expected_size);
+	TEST_ASSERT(*t, vec_in == vec_out);
+
+	TEST_ASSERT(*t, test.write(big, vec_in, opposite_endian) == expected_size);
+	for (size_t i = 0; i < vec_in.size(); ++i)
+	{
+		int value;
+		std::memcpy(&value, big + 1 + i * sizeof(int), sizeof(int));
+		TEST_ASSERT(*t, std::byteswap(value) == vec_in[i]);
+	}
+	auto bytes = std::span<const std::byte>(big);
+	TEST_ASSERT(*t, test.construct(bytes, opposite_endian) == vec_in);
+	return true;
+}
+
+bool serializer_helper_ranges_vector_enum(test* t)
+{
+	enum class color : std::uint16_t { red = 0x0102, green = 0x0304 };
+
+	std::byte                      big[64]{};
+	std::vector<color>             vec_in{ color::red, color::green, color::red };
+	std::vector<color>             vec_out{};
+	shion::serializer_helper<std::vector<color>> test;
+	std::ptrdiff_t expected_size = (1 + vec_in.size() * sizeof(color));
+	auto opposite_endian = std::endian::native == std::endian::big ? std::endian::little : std::endian::big;
+
+	// Enums are swapped on write like integers, so they must be swapped back on read
+	TEST_ASSERT(*t, test.write(big, vec_in, opposite_endian) == expected_size);
+	TEST_ASSERT(*t, test.read(big, vec_out, opposite_endian) == expected_size);
+	TEST_ASSERT(*t, vec_in == vec_out);
+	auto bytes = std::span<const std::byte>(big);
+	TEST_ASSERT(*t, test.construct(bytes, opposite_endian) == vec_in);
+	return true;
+}
+
 bool serializer_helper_fundamental(test& t) {
 	if (!serializer_helper_fundamental_impl(&t, 42))
 		return false;
@@ -218,6 +269,12 @@ bool serializer_helper_contiguous_ranges(test& t) {
 	if (!serializer_helper_ranges_vector_string(&t))
 		return false;
 
+	if (!serializer_helper_ranges_vector_int(&t))
+		return false;
+
+	if (!serializer_helper_ranges_vector_enum(&t))
+		return false;
+
 	return true;
 }
 
@@ -297,4 +354,237 @@ bool serializer_helper_list_ranges(test& t) {
 	return true;
 }
 
+bool serializer_helper_hive_trivial(test* t)
+{
+	shion::handle_hive<int> hive_in;
+	std::vector<shion::handle_hive<int>::handle> handles;
+
+	for (int i = 0; i < 5000; ++i)
+		handles.push_back(hive_in.emplace(i).to_handle());
+	hive_in.erase_if([](int i) { return i % 3 == 0 || (i >= 1000 && i < 3000); });
+
+	shion::serializer_helper<shion::handle_hive<int>> test;
+	std::ptrdiff_t expected_size = test.write({}, hive_in);
+	std::vector<std::byte> big(expected_size);
+
+	TEST_ASSERT(*t, expected_size > 0);
+	TEST_ASSERT(*t, test.write(big, hive_in) == expected_size);
+	TEST_ASSERT(*t, test.size(big) == expected_size);
+	TEST_ASSERT(*t, test.size(std::span{big}.subspan(0, 4)) < 0);
+
+	shion::handle_hive<int> hive_out;
+	hive_out.emplace(-1);
+	TEST_ASSERT(*t, test.read(big, hive_out) == expected_size);
+	TEST_ASSERT(*t, hive_out.size() == hive_in.size());
+	TEST_ASSERT(*t, hive_out.pages() == hive_in.pages());
+	TEST_ASSERT(*t, hive_out.last_raw_index() == hive_in.last_raw_index());
+	for (int i = 0; i < 5000; ++i)
+	{
+		auto const* value = hive_out.get(handles[i]);
+
+		TEST_ASSERT(*t, (value != nullptr) == (hive_in.get(handles[i]) != nullptr));
+		TEST_ASSERT(*t, value == nullptr || *value == i);
+	}
+
+	// Restored hives keep working like the original: new elements fill the holes and get fresh generations
+	auto it = hive_out.emplace(42);
+	TEST_ASSERT(*t, hive_out.at_raw_index(it.raw_index()) == it);
+	TEST_ASSERT(*t, !hive_in.get(it.to_handle()));
+
+	auto bytes = std::span<const std::byte>(big);
+	auto constructed = test.construct(bytes);
+	TEST_ASSERT(*t, bytes.empty());
+	TEST_ASSERT(*t, constructed.size() == hive_in.size());
+	for (int const& value : hive_in)
+	{
+		auto it = constructed.at_raw_index(hive_in.get_iterator(&value).raw_index());
+
+		TEST_ASSERT(*t, it != constructed.end() && *it == value);
+	}
+
+	shion::handle_hive<int, shion::hive_page_size<1024>> small_pages;
+	TEST_ASSERT(*t, shion::serializer_helper<decltype(small_pages)>{}.read(big, small_pages) == 0);
+
+	// Snapshots with generations cannot be read into a hive without them
+	shion::hive<int> no_handles;
+	TEST_ASSERT(*t, shion::serializer_helper<decltype(no_handles)>{}.read(big, no_handles) == 0);
+
+	// Free slots are written as zeroes, whatever they last held
+	shion::hive<int> erased;
+	shion::hive<int> fresh;
+	shion::serializer_helper<shion::hive<int>> plain;
+	for (int i = 0; i < 100; ++i)
+	{
+		erased.emplace(i + 1);
+		if (i % 2 == 0)
+			fresh.try_emplace(i, i + 1);
+	}
+	erased.erase_if([](int i) { return i % 2 == 0; });
+	std::vector<std::byte> erased_bytes(plain.write({}, erased));
+	std::vector<std::byte> fresh_bytes(plain.write({}, fresh));
+	TEST_ASSERT(*t, plain.write(erased_bytes, erased) == std::ssize(erased_bytes));
+	TEST_ASSERT(*t, plain.write(fresh_bytes, fresh) == std::ssize(fresh_bytes));
+	TEST_ASSERT(*t, erased_bytes == fresh_bytes);
+
+	// Corrupt page counts and indices are rejected rather than allocated for
+	auto corrupt = [&](std::ptrdiff_t offset, std::uint64_t word) {
+		std::vector<std::byte> bytes = erased_bytes;
+		std::memcpy(bytes.data() + offset, &word, sizeof(word));
+		return plain.read(bytes, no_handles) == 0;
+	};
+	TEST_ASSERT(*t, corrupt(sizeof(std::uint64_t), ~std::uint64_t{0}));
+	TEST_ASSERT(*t, corrupt(3 * sizeof(std::uint64_t), std::uint64_t{1} << 40));
+	TEST_ASSERT(*t, corrupt(3 * sizeof(std::uint64_t), erased_bytes.size() + 1));
+	TEST_ASSERT(*t, plain.read(erased_bytes, no_handles) == std::ssize(erased_bytes));
+	return true;
+}
+
+bool serializer_helper_hive_elements(test* t)
+{
+	shion::hive<std::string> hive_in;
+	std::ptrdiff_t expected_size = 0;
+
+	for (int i = 0; i < 200; ++i)
+		hive_in.emplace(std::string(i % 17, 'a'));
+	hive_in.erase_if([](std::string const& str) { return str.size() % 2 == 0; });
+
+	shion::serializer_helper<shion::hive<std::string>> test;
+	expected_size = test.write({}, hive_in);
+	std::vector<std::byte> big(expected_size);
+	shion::hive<std::string> hive_out;
+
+	TEST_ASSERT(*t, test.write(big, hive_in) == expected_size);
+	TEST_ASSERT(*t, test.size(big) == expected_size);
+	TEST_ASSERT(*t, test.size(std::span{big}.subspan(0, 100)) < 0);
+	TEST_ASSERT(*t, test.read(std::span{big}.subspan(0, expected_size - 1), hive_out) == 0);
+	TEST_ASSERT(*t, test.read(big, hive_out) == expected_size);
+	TEST_ASSERT(*t, hive_out.size() == hive_in.size());
+	for (auto const& str : hive_in)
+	{
+		auto it = hive_out.at_raw_index(hive_in.get_iterator(&str).raw_index());
+
+		TEST_ASSERT(*t, it != hive_out.end() && *it == str);
+	}
+	return true;
+}
+
+bool serializer_helper_hive(test& t) {
+	if (!serializer_helper_hive_trivial(&t))
+		return false;
+
+	if (!serializer_helper_hive_elements(&t))
+		return false;
+
+	return true;
+}
+
+bool serializer_helper_views_span(test* t)
+{
+	alignas(int) std::byte         big[64]{};
+	std::vector<int>               vec_in{ 1, 2, 4, 8 };
+	std::span<const int>           view_out{};
+	shion::serializer_helper<std::span<const int>> test;
+	std::ptrdiff_t expected_size = (1 + vec_in.size() * sizeof(int));
+	auto opposite_endian = std::endian::native == std::endian::big ? std::endian::little : std::endian::big;
+	// The size takes a byte: write it right before an aligned address, so that the elements can be viewed in place
+	auto aligned = std::span{big}.subspan(alignof(int) - 1);
+	auto misaligned = std::span{big}.subspan(alignof(int));
+
+	TEST_ASSERT(*t, test.write({}, vec_in) == expected_size);
+	TEST_ASSERT(*t, test.write(aligned, vec_in) == expected_size);
+	TEST_ASSERT(*t, test.size({}) == -1);
+	TEST_ASSERT(*t, test.size(aligned) == expected_size);
+	TEST_ASSERT(*t, test.viewable(aligned));
+	TEST_ASSERT(*t, test.read(aligned, view_out) == expected_size);
+	TEST_ASSERT(*t, std::ranges::equal(vec_in, view_out));
+	TEST_ASSERT(*t, static_cast<const void*>(view_out.data()) == aligned.data() + 1);
+
+	auto bytes = std::span<const std::byte>(aligned).first(expected_size);
+	TEST_ASSERT(*t, std::ranges::equal(test.construct(bytes), vec_in));
+	TEST_ASSERT(*t, bytes.empty());
+
+	// Written like any other range
+	std::vector<int> vec_out;
+	TEST_ASSERT(*t, shion::serializer_helper<std::vector<int>>{}.read(aligned, vec_out) == expected_size);
+	TEST_ASSERT(*t, vec_in == vec_out);
+
+	TEST_ASSERT(*t, test.read(aligned.first(expected_size - 1), view_out) == 0);
+	TEST_ASSERT(*t, !test.viewable(aligned, opposite_endian));
+	TEST_ASSERT(*t, test.write(misaligned, vec_in) == expected_size);
+	TEST_ASSERT(*t, !test.viewable(misaligned));
+	TEST_ASSERT(*t, test.read(misaligned, view_out) == 0);
+	return true;
+}
+
+bool serializer_helper_views_string(test* t)
+{
+	std::byte                      big[64]{};
+	std::string                    str_in("hello world!");
+	std::string_view               view_out{};
+	shion::serializer_helper<std::string_view> test;
+	std::ptrdiff_t expected_size = (1 + str_in.size());
+	auto opposite_endian = std::endian::native == std::endian::big ? std::endian::little : std::endian::big;
+
+	TEST_ASSERT(*t, test.write({}, str_in) == expected_size);
+	TEST_ASSERT(*t, shion::serializer_helper<std::string>{}.write(big, str_in) == expected_size);
+	TEST_ASSERT(*t, test.size({}) == -1);
+	TEST_ASSERT(*t, test.read(big, view_out) == expected_size);
+	TEST_ASSERT(*t, view_out == str_in);
+	TEST_ASSERT(*t, static_cast<const void*>(view_out.data()) == big + 1);
+
+	// Characters are single bytes, any endianness and alignment can be viewed
+	TEST_ASSERT(*t, test.read(big, view_out, opposite_endian) == expected_size);
+	TEST_ASSERT(*t, view_out == str_in);
+	return true;
+}
+
+bool serializer_helper_views_tuple(test* t)
+{
+	using record = std::tuple<int, std::string, std::vector<int>, char>;
+	using record_view = std::tuple<int, std::string_view, std::span<const int>, char>;
+	// A 2 character string brings the vector's elements to offset 8
+	record                         record_in{ 42, "ab", { 1, 2, 4, 8 }, 'z' };
+	shion::serializer_helper<record> test;
+	std::ptrdiff_t expected_size = test.write({}, record_in);
+	std::vector<std::byte> big(expected_size);
+
+	TEST_ASSERT(*t, test.write(big, record_in) == expected_size);
+
+	shion::serialized_view<record_view> view{ big };
+	TEST_ASSERT(*t, view.offset<1>() == sizeof(int));
+	TEST_ASSERT(*t, view.offset<3>() == static_cast<size_t>(expected_size - 1));
+	TEST_ASSERT(*t, view.get<0>() == 42);
+	TEST_ASSERT(*t, view.get<1>() == "ab");
+	TEST_ASSERT(*t, std::ranges::equal(view.get<2>(), std::get<2>(record_in)));
+	TEST_ASSERT(*t, view.get<3>() == 'z');
+	TEST_ASSERT(*t, std::get<1>(view.materialize()).data() == view.get<1>().data());
+
+	// Views are serializable themselves: reading one only checks its size, writing one copies its bytes
+	shion::serializer_helper<shion::serialized_view<record>> view_test;
+	shion::serialized_view<record> view_out;
+	std::vector<std::byte> copy(expected_size);
+
+	TEST_ASSERT(*t, view_test.size(big) == expected_size);
+	TEST_ASSERT(*t, view_test.read(std::span{big}.first(expected_size - 1), view_out) == 0);
+	TEST_ASSERT(*t, view_test.read(big, view_out) == expected_size);
+	TEST_ASSERT(*t, view_out.materialize() == record_in);
+	TEST_ASSERT(*t, view_test.write({}, view_out) == expected_size);
+	TEST_ASSERT(*t, view_test.write(copy, view_out) == expected_size);
+	TEST_ASSERT(*t, copy == big);
+	return true;
+}
+
+bool serializer_helper_views(test& t) {
+	if (!serializer_helper_views_span(&t))
+		return false;
+
+	if (!serializer_helper_views_string(&t))
+		return false;
+
+	if (!serializer_helper_views_tuple(&t))
+		return false;
+
+	return true;
+}
+
 }
@@ -18,18 +18,55 @@ std::vector<test_suite> init() {
 	auto& containers = ret.emplace_back("Containers");
 	containers.make_test("hive with trivial type", &hive_test_trivial);
 	containers.make_test("hive with non-trivial type", &hive_test_nontrivial);
+	containers.make_test("hive bulk insert and erase", &hive_test_bulk);
+	containers.make_test("hive segmented iteration", &hive_test_segments);
+	containers.make_test("hive parallel_for_each", &hive_test_parallel_for_each);
+	containers.make_test("hive page size and allocator", &hive_test_allocator);
+	containers.make_test("hive page reclamation", &hive_test_trim);
+	containers.make_test("hive compaction", &hive_test_compact);
+	containers.make_test("hive get_iterator", &hive_test_get_iterator);
+	containers.make_test("hive handles", &hive_test_handles);
+	containers.make_test("concurrent hive", &hive_test_concurrent);
+	containers.make_test("structure-of-arrays hive", &hive_test_soa);
 
 	auto& io = ret.emplace_back("I/O");
 	io.make_test("serializer_helper with fundamental types", &serializer_helper_fundamental);
 	io.make_test("serializer_helper with tuples", &serializer_helper_tuples);
 	io.make_test("serializer_helper with contiguous ranges", &serializer_helper_contiguous_ranges);
 	io.make_test("serializer_helper with list ranges", &serializer_helper_list_ranges);
+	io.make_test("serializer_helper with hives", &serializer_helper_hive);
+	io.make_test("serializer_helper with views", &serializer_helper_views);
 
 	auto& coro = ret.emplace_back("Coro");
 	coro.make_test("state_machine simple generator", &state_machine_generator);
 	coro.make_test("state_machine awaitable", &state_machine_coroutine);
 	coro.make_test("state_machine continuation", &state_machine_continuation);
 
+	auto& cache = ret.emplace_back("Cache");
+	cache.make_test("cache sharding", &cache_test_shards);
+	cache.make_test("cache index", &cache_test_index);
+	cache.make_test("cache eviction", &cache_test_eviction);
+	cache.make_test("cache expiry", &cache_test_expiry);
+	cache.make_test("cache get_or_load", &cache_test_load);
+	cache.make_test("cache statistics", &cache_test_stats);
+	cache.make_test("cache lock-free reads", &cache_test_lock_free_reads);
+	cache.make_test("cache heterogeneous and batch find", &cache_test_batch_find);
+	cache.make_test("cache references", &cache_test_references);
+	cache.make_test("cache snapshots", &cache_test_snapshot);
+
+#if SHION_BUILD_BENCHMARKS
+	auto& benchmarks = ret.emplace_back("Benchmarks");
+	benchmarks.make_test("hive emplace benchmark", &hive_bench_emplace);
+	benchmarks.make_test("hive iteration benchmark", &hive_bench_iteration);
+	benchmarks.make_test("hive compaction benchmark", &hive_bench_compact);
+	benchmarks.make_test("hive copy benchmark", &hive_bench_copy);
+	benchmarks.make_test("hive parallel_for_each benchmark", &hive_bench_parallel_for_each);
+	benchmarks.make_test("cache find benchmark", &cache_bench_find);
+	benchmarks.make_test("cache batch find benchmark", &cache_bench_batch_find);
+	benchmarks.make_test("cache reference copy benchmark", &cache_bench_reference_copies);
+	benchmarks.make_test("cache snapshot benchmark", &cache_bench_snapshot);
+#endif
+
 	return ret;
 }
 